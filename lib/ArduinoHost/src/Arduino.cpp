@@ -0,0 +1,112 @@
+/*
+    Arduino core shim for native (Linux) builds
+    Timing, Print/Stream helpers and program entry point
+*/
+#include "Arduino.h"
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+
+static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const uint64_t startUs = monotonicUs();
+
+uint32_t micros() {
+    return (uint32_t)(monotonicUs() - startUs);
+}
+
+uint32_t millis() {
+    return (uint32_t)((monotonicUs() - startUs) / 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    struct timespec ts = {(time_t)(us / 1000000UL), (long)(us % 1000000UL) * 1000L};
+    while (nanosleep(&ts, &ts) == -1) ;
+}
+
+void delay(uint32_t ms) {
+    delayMicroseconds(ms * 1000UL);
+}
+
+void yield() {
+    sched_yield();
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        if (!write(*buffer++)) break;
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(long v, int base) {
+    if (base == DEC) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%ld", v);
+        return write(buf);
+    }
+    return print((unsigned long)v, base);
+}
+
+size_t Print::print(unsigned long v, int base) {
+    char buf[8 * sizeof(long) + 1];
+    char* p = &buf[sizeof(buf) - 1];
+    *p = '\0';
+    if (base < 2) base = DEC;
+    do {
+        char c = v % base;
+        v /= base;
+        *--p = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (v);
+    return write(p);
+}
+
+size_t Print::print(double v, int digits) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, v);
+    return write(buf);
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write((const uint8_t*)buf, (size_t)len < sizeof(buf) ? len : sizeof(buf) - 1);
+}
+
+int Stream::timedRead() {
+    uint32_t start = millis();
+    do {
+        int c = read();
+        if (c >= 0) return c;
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int c = timedRead();
+        if (c < 0) break;
+        *buffer++ = (uint8_t)c;
+        count++;
+    }
+    return count;
+}
+
+int main(int, char**) {
+    setup();
+    for (;;)
+        loop();
+    return 0;
+}
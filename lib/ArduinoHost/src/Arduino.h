@@ -0,0 +1,56 @@
+/*
+    Arduino core shim for native (Linux) builds
+    Only the subset used by the simulator and modbus-esp8266 is provided.
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define ARDUINO 10800
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT         0x01
+#define OUTPUT        0x03
+#define INPUT_PULLUP  0x05
+
+#define PROGMEM
+#define PGM_P const char*
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// GPIO is not available on host. Calls are accepted and ignored.
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+
+// Sketch entry points. main() is provided by the shim.
+void setup();
+void loop();
+
+#include "WString.h"
+#include "IPAddress.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
@@ -0,0 +1,178 @@
+/*
+    Arduino core shim for native (Linux) builds
+    HardwareSerial backed by a pseudo terminal or a serial device
+*/
+#include "Arduino.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+HardwareSerial Serial(0);
+
+static speed_t toSpeed(unsigned long baud) {
+    switch (baud) {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B9600;
+    }
+}
+
+HardwareSerial::~HardwareSerial() {
+    end();
+    if (_fd >= 0)
+        close(_fd);
+    if (_ptySlave >= 0)
+        close(_ptySlave);
+}
+
+bool HardwareSerial::open() {
+    if (_fd >= 0)
+        return true;
+    if (_uart_nr == 0) {
+        _fd = STDOUT_FILENO;
+        strncpy(_name, "stdout", sizeof(_name) - 1);
+        return true;
+    }
+    char var[24];
+    snprintf(var, sizeof(var), "HOST_SERIAL%d", _uart_nr);
+    const char* dev = getenv(var);
+    if (dev && *dev) {
+        _fd = ::open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd < 0) {
+            fprintf(stderr, "HardwareSerial(%d): %s: %s\n", _uart_nr, dev, strerror(errno));
+            return false;
+        }
+        strncpy(_name, dev, sizeof(_name) - 1);
+        _isPty = false;
+    } else {
+        _fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd < 0 || grantpt(_fd) || unlockpt(_fd)) {
+            fprintf(stderr, "HardwareSerial(%d): pty: %s\n", _uart_nr, strerror(errno));
+            if (_fd >= 0)
+                close(_fd);
+            _fd = -1;
+            return false;
+        }
+        strncpy(_name, ptsname(_fd), sizeof(_name) - 1);
+        _ptySlave = ::open(_name, O_RDWR | O_NOCTTY);
+        _isPty = true;
+        fprintf(stderr, "HardwareSerial(%d): %s\n", _uart_nr, _name);
+    }
+    return true;
+}
+
+void HardwareSerial::configure(unsigned long baud, uint32_t config) {
+    struct termios tio;
+    int fd = _isPty ? _ptySlave : _fd;
+    if (fd < 0 || tcgetattr(fd, &tio))
+        return;
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD);
+    switch ((config >> 1) & 0x03) {
+    case 0: tio.c_cflag |= CS5; break;
+    case 1: tio.c_cflag |= CS6; break;
+    case 2: tio.c_cflag |= CS7; break;
+    default: tio.c_cflag |= CS8; break;
+    }
+    if (config & 0x08)
+        tio.c_cflag |= CSTOPB;
+    if ((config & 0x30) == 0x20)
+        tio.c_cflag |= PARENB;
+    else if ((config & 0x30) == 0x30)
+        tio.c_cflag |= PARENB | PARODD;
+    tio.c_cflag |= CLOCAL | CREAD;
+    cfsetispeed(&tio, toSpeed(baud));
+    cfsetospeed(&tio, toSpeed(baud));
+    tcsetattr(fd, TCSANOW, &tio);
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t, int8_t) {
+    if (!open())
+        return;
+    _baud = baud;
+    if (_uart_nr != 0)
+        configure(baud, config);
+}
+
+void HardwareSerial::end() {
+    _rxHead = _rxTail = 0;
+    // Pseudo terminal is kept over end()/begin() so the peer does not lose its device on reconfiguration
+    if (_isPty || _uart_nr == 0 || _fd < 0)
+        return;
+    close(_fd);
+    _fd = -1;
+}
+
+void HardwareSerial::fill() {
+    if (_fd < 0 || _uart_nr == 0)
+        return;
+    while (true) {
+        size_t head = _rxHead % HOST_SERIAL_RX_BUFFER;
+        size_t used = _rxHead - _rxTail;
+        if (used >= HOST_SERIAL_RX_BUFFER)
+            return;
+        size_t room = HOST_SERIAL_RX_BUFFER - used;
+        if (room > HOST_SERIAL_RX_BUFFER - head)
+            room = HOST_SERIAL_RX_BUFFER - head;
+        ssize_t n = ::read(_fd, _rx + head, room);
+        if (n <= 0)
+            return;
+        _rxHead += n;
+    }
+}
+
+int HardwareSerial::available() {
+    fill();
+    return _rxHead - _rxTail;
+}
+
+int HardwareSerial::peek() {
+    if (!available())
+        return -1;
+    return _rx[_rxTail % HOST_SERIAL_RX_BUFFER];
+}
+
+int HardwareSerial::read() {
+    int c = peek();
+    if (c >= 0)
+        _rxTail++;
+    return c;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    if (_fd < 0)
+        return 0;
+    size_t sent = 0;
+    uint32_t start = millis();
+    while (sent < size) {
+        ssize_t n = ::write(_fd, buffer + sent, size - sent);
+        if (n > 0) {
+            sent += n;
+            start = millis();
+        } else if (n < 0 && (errno == EAGAIN || errno == EINTR) && millis() - start < _timeout) {  // Drop output if peer stopped reading
+            struct pollfd p = {_fd, POLLOUT, 0};
+            poll(&p, 1, 10);
+        } else {
+            break;
+        }
+    }
+    return sent;
+}
+
+void HardwareSerial::flush() {
+    // Pseudo terminal has no line timing to wait for
+    if (_fd >= 0 && !_isPty && _uart_nr != 0)
+        tcdrain(_fd);
+}
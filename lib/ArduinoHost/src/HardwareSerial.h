@@ -0,0 +1,73 @@
+/*
+    Arduino core shim for native (Linux) builds
+    HardwareSerial backed by a pseudo terminal or a serial device
+
+    Port 0 (Serial) writes to stdout.
+    Port N > 0 opens the device named by HOST_SERIAL<N> environment variable
+    (e.g. HOST_SERIAL1=/dev/ttyUSB0). If the variable is not set a pseudo terminal
+    is created and its slave name is printed to stderr, so any Modbus master can open it.
+*/
+#pragma once
+#include "Stream.h"
+
+// Same encoding as AVR core: bits 1-2 data bits - 5, bit 3 two stop bits, bits 4-5 parity
+#define SERIAL_5N1 0x00
+#define SERIAL_6N1 0x02
+#define SERIAL_7N1 0x04
+#define SERIAL_8N1 0x06
+#define SERIAL_5N2 0x08
+#define SERIAL_6N2 0x0A
+#define SERIAL_7N2 0x0C
+#define SERIAL_8N2 0x0E
+#define SERIAL_5E1 0x20
+#define SERIAL_6E1 0x22
+#define SERIAL_7E1 0x24
+#define SERIAL_8E1 0x26
+#define SERIAL_5E2 0x28
+#define SERIAL_6E2 0x2A
+#define SERIAL_7E2 0x2C
+#define SERIAL_8E2 0x2E
+#define SERIAL_5O1 0x30
+#define SERIAL_6O1 0x32
+#define SERIAL_7O1 0x34
+#define SERIAL_8O1 0x36
+#define SERIAL_5O2 0x38
+#define SERIAL_6O2 0x3A
+#define SERIAL_7O2 0x3C
+#define SERIAL_8O2 0x3E
+
+#define HOST_SERIAL_RX_BUFFER 1024
+
+class HardwareSerial : public Stream {
+    public:
+    HardwareSerial(int uart_nr) : _uart_nr(uart_nr) {}
+    ~HardwareSerial();
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+    void end();
+    uint32_t baudRate() { return _baud; }
+    const char* portName() { return _name; }
+    int fd() const { return _fd; }     // Device descriptor to wait for input on, -1 if not open
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void flush() override;
+    operator bool() const { return _fd >= 0; }
+    private:
+    int _uart_nr;
+    int _fd = -1;
+    int _ptySlave = -1;     // Slave side kept open to avoid EIO on master while no peer is connected
+    bool _isPty = false;
+    uint32_t _baud = 0;
+    char _name[64] = "";
+    uint8_t _rx[HOST_SERIAL_RX_BUFFER];
+    size_t _rxHead = 0;
+    size_t _rxTail = 0;
+    bool open();
+    void configure(unsigned long baud, uint32_t config);
+    void fill();
+};
+
+extern HardwareSerial Serial;
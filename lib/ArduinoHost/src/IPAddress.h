@@ -0,0 +1,51 @@
+/*
+    Arduino core shim for native (Linux) builds
+    IPv4 address. Bytes are kept in network order as in Arduino cores,
+    so uint32_t value can be used as in_addr.s_addr directly.
+*/
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "WString.h"
+
+class IPAddress {
+    public:
+    IPAddress() { _addr.dword = 0; }
+    IPAddress(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) {
+        _addr.bytes[0] = b0;
+        _addr.bytes[1] = b1;
+        _addr.bytes[2] = b2;
+        _addr.bytes[3] = b3;
+    }
+    IPAddress(uint32_t address) { _addr.dword = address; }
+    IPAddress(const uint8_t* address) { memcpy(_addr.bytes, address, 4); }
+    operator uint32_t() const { return _addr.dword; }
+    bool operator==(const IPAddress& rhs) const { return _addr.dword == rhs._addr.dword; }
+    bool operator!=(const IPAddress& rhs) const { return _addr.dword != rhs._addr.dword; }
+    bool operator==(uint32_t rhs) const { return _addr.dword == rhs; }
+    uint8_t operator[](int index) const { return _addr.bytes[index]; }
+    uint8_t& operator[](int index) { return _addr.bytes[index]; }
+    bool fromString(const char* address) {
+        unsigned b[4];
+        char tail;
+        if (sscanf(address, "%u.%u.%u.%u%c", &b[0], &b[1], &b[2], &b[3], &tail) != 4)
+            return false;
+        for (int i = 0; i < 4; i++) {
+            if (b[i] > 255)
+                return false;
+            _addr.bytes[i] = b[i];
+        }
+        return true;
+    }
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr.bytes[0], _addr.bytes[1], _addr.bytes[2], _addr.bytes[3]);
+        return String(buf);
+    }
+    private:
+    union {
+        uint8_t bytes[4];
+        uint32_t dword;
+    } _addr;
+};
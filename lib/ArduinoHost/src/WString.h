@@ -0,0 +1,34 @@
+/*
+    Arduino core shim for native (Linux) builds
+    String class backed by std::string
+*/
+#pragma once
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+
+class String {
+    public:
+    String(const char* s = "") : _s(s ? s : "") {}
+    String(const std::string& s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned int v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+    String(float v, unsigned int decimals = 2) : String((double)v, decimals) {}
+    String(double v, unsigned int decimals = 2) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        _s = buf;
+    }
+    const char* c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.length(); }
+    char operator[](unsigned int i) const { return _s[i]; }
+    bool operator==(const String& rhs) const { return _s == rhs._s; }
+    bool operator!=(const String& rhs) const { return _s != rhs._s; }
+    String& operator+=(const String& rhs) { _s += rhs._s; return *this; }
+    friend String operator+(const String& lhs, const String& rhs) { return String(lhs._s + rhs._s); }
+    private:
+    std::string _s;
+};
@@ -0,0 +1,194 @@
+/*
+    Arduino core shim for native (Linux) builds
+    WiFiClient and WiFiServer backed by POSIX TCP sockets
+*/
+#include "WiFi.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+WiFiClass WiFi;
+
+WiFiClient::Socket::~Socket() {
+    if (fd >= 0)
+        close(fd);
+}
+
+WiFiClient::WiFiClient(int fd) {
+    if (fd < 0)
+        return;
+    _socket = std::make_shared<Socket>(fd);
+    setPeer();
+}
+
+void WiFiClient::setPeer() {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(_socket->fd, (struct sockaddr*)&addr, &len) == 0 && addr.sin_family == AF_INET) {
+        _remoteIP = IPAddress((uint32_t)addr.sin_addr.s_addr);
+        _remotePort = ntohs(addr.sin_port);
+    }
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    stop();
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return 0;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+    if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return 0;
+        }
+        struct pollfd p = {fd, POLLOUT, 0};
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&p, 1, timeout) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) || err) {
+            close(fd);
+            return 0;
+        }
+    }
+    _socket = std::make_shared<Socket>(fd);
+    setPeer();
+    return 1;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip))
+        return 0;
+    return connect(ip, port);
+}
+
+uint8_t WiFiClient::connected() {
+    if (!_socket)
+        return 0;
+    char c;
+    ssize_t r = recv(_socket->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (r > 0)
+        return 1;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 1;
+    return 0;   // Closed by peer or failed
+}
+
+int WiFiClient::available() {
+    int count = 0;
+    if (!_socket || ioctl(_socket->fd, FIONREAD, &count) < 0)
+        return 0;
+    return count;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+    if (!_socket)
+        return -1;
+    ssize_t r = recv(_socket->fd, buffer, size, MSG_DONTWAIT);
+    return r > 0 ? r : -1;
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::peek() {
+    uint8_t c;
+    if (!_socket || recv(_socket->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1)
+        return -1;
+    return c;
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+    if (!_socket)
+        return 0;
+    size_t sent = 0;
+    while (sent < size) {   // Never blocks, returns count of bytes socket has accepted
+        ssize_t n = send(_socket->fd, buffer + sent, size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0)
+            sent += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else
+            break;
+    }
+    return sent;
+}
+
+void WiFiClient::stop() {
+    _socket.reset();
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+    int flag = nodelay;
+    if (!_socket)
+        return -1;
+    return setsockopt(_socket->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+void WiFiServer::begin(uint16_t port) {
+    if (port)
+        _port = port;
+    end();
+    _fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        fprintf(stderr, "WiFiServer(%u): %s\n", _port, strerror(errno));
+        return;
+    }
+    int flag = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(_fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(_fd, SOMAXCONN)) {
+        fprintf(stderr, "WiFiServer(%u): %s\n", _port, strerror(errno));
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+void WiFiServer::end() {
+    if (_fd >= 0)
+        close(_fd);
+    _fd = -1;
+}
+
+WiFiClient WiFiServer::available() {
+    if (_fd < 0)
+        return WiFiClient();
+    int fd = accept4(_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return WiFiClient();
+    WiFiClient client(fd);
+    if (_noDelay)
+        client.setNoDelay(true);
+    return client;
+}
+
+bool WiFiServer::hasClient() {
+    struct pollfd p = {_fd, POLLIN, 0};
+    return _fd >= 0 && poll(&p, 1, 0) == 1;
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+    struct addrinfo hints = {};
+    struct addrinfo* res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, nullptr, &hints, &res) || !res)
+        return 0;
+    result = IPAddress((uint32_t)((struct sockaddr_in*)res->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(res);
+    return 1;
+}
@@ -0,0 +1,75 @@
+/*
+    Arduino core shim for native (Linux) builds
+    WiFiClient and WiFiServer backed by POSIX TCP sockets
+
+    Named after ESP32 core classes so ModbusTCP and ModbusRTUTCP build unchanged,
+    host network interfaces are used instead of WiFi. Sockets are non-blocking and
+    provide fd() to be polled, write() returns count of bytes socket has accepted at once. Copies of WiFiClient share the socket as on ESP32,
+    it is closed by stop() or when the last copy is destroyed.
+*/
+#pragma once
+#include "Arduino.h"
+#include <memory>
+#include <netinet/in.h>
+
+#define HOST_CONNECT_TIMEOUT 3000
+
+class WiFiClient : public Stream {
+    public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd);
+    int connect(IPAddress ip, uint16_t port) { return connect(ip, port, HOST_CONNECT_TIMEOUT); }
+    int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const char* host, uint16_t port);
+    uint8_t connected();
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size);
+    int peek() override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void flush() override {}   // Data is passed to the kernel by write()
+    void stop();
+    int setNoDelay(bool nodelay);
+    int fd() const { return _socket ? _socket->fd : -1; }
+    IPAddress remoteIP() const { return _remoteIP; }
+    uint16_t remotePort() const { return _remotePort; }
+    operator bool() { return connected(); }
+    bool operator==(const WiFiClient& rhs) const { return _socket == rhs._socket; }
+    private:
+    struct Socket {
+        int fd;
+        Socket(int f) : fd(f) {}
+        ~Socket();
+    };
+    std::shared_ptr<Socket> _socket;
+    IPAddress _remoteIP;
+    uint16_t _remotePort = 0;
+    void setPeer();
+};
+
+class WiFiServer {
+    public:
+    WiFiServer(uint16_t port = 80, uint8_t /*maxClients*/ = 4) : _port(port) {}
+    ~WiFiServer() { end(); }
+    void begin(uint16_t port = 0);
+    void end();
+    WiFiClient available();    // Accepts pending connection as ESP32 core does
+    WiFiClient accept() { return available(); }
+    bool hasClient();
+    void setNoDelay(bool nodelay) { _noDelay = nodelay; }
+    int fd() const { return _fd; }
+    operator bool() const { return _fd >= 0; }
+    private:
+    uint16_t _port;
+    int _fd = -1;
+    bool _noDelay = false;
+};
+
+class WiFiClass {
+    public:
+    int hostByName(const char* host, IPAddress& result);
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,301 @@
+/*
+    Arduino core shim for native (Linux) builds
+    WiFiClientSecure and WiFiServerSecure backed by OpenSSL. Compiled with -D HOST_TLS only
+*/
+#if defined(HOST_TLS)
+#include "WiFiServerSecure.h"
+#include <poll.h>
+#include <signal.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+namespace BearSSL {
+
+X509List::X509List(const char* pem) {
+    if (!pem)
+        return;
+    BIO* bio = BIO_new_mem_buf(pem, -1);
+    X509* cert;
+    while (bio && (cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)))
+        _certs.push_back(cert);
+    ERR_clear_error();  // End of data is reported as error
+    BIO_free(bio);
+}
+
+X509List::~X509List() {
+    for (X509* cert : _certs)
+        X509_free(cert);
+}
+
+PrivateKey::PrivateKey(const char* pem) {
+    if (!pem)
+        return;
+    BIO* bio = BIO_new_mem_buf(pem, -1);
+    if (bio)
+        _key = PEM_read_bio_PrivateKey(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+}
+
+PrivateKey::~PrivateKey() {
+    EVP_PKEY_free(_key);
+}
+
+PublicKey::PublicKey(const char* pem) {
+    if (!pem)
+        return;
+    BIO* bio = BIO_new_mem_buf(pem, -1);
+    if (bio)
+        _key = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+}
+
+PublicKey::~PublicKey() {
+    EVP_PKEY_free(_key);
+}
+
+void Session::set(SSL_SESSION* session) {
+    if (_session)
+        SSL_SESSION_free(_session);
+    _session = session;
+}
+
+}
+
+// Context settings matching BearSSL: TLS 1.2 only, no session tickets
+static SSL_CTX* tlsContext(const SSL_METHOD* method) {
+    SSL_CTX* ctx = SSL_CTX_new(method);
+    if (!ctx)
+        return nullptr;
+    signal(SIGPIPE, SIG_IGN);   // OpenSSL writes to socket without MSG_NOSIGNAL
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    return ctx;
+}
+
+static bool tlsCertificate(SSL_CTX* ctx, const BearSSL::X509List* chain, const BearSSL::PrivateKey* sk) {
+    if (!chain || !chain->getCount() || !sk || !sk->get())
+        return false;
+    if (SSL_CTX_use_certificate(ctx, chain->get(0)) != 1 || SSL_CTX_use_PrivateKey(ctx, sk->get()) != 1)
+        return false;
+    for (size_t i = 1; i < chain->getCount(); i++) {
+        X509_up_ref(chain->get(i));     // Owned by context
+        SSL_CTX_add_extra_chain_cert(ctx, chain->get(i));
+    }
+    return true;
+}
+
+static void tlsTrust(SSL_CTX* ctx, const BearSSL::X509List* ta, int mode) {
+    X509_STORE* store = SSL_CTX_get_cert_store(ctx);
+    for (size_t i = 0; i < ta->getCount(); i++)
+        X509_STORE_add_cert(store, ta->get(i));
+    SSL_CTX_set_verify(ctx, mode, nullptr);
+}
+
+static bool tlsHandshake(SSL* ssl, int fd, bool server) {
+    uint32_t start = millis();
+    for (;;) {
+        int r = server ? SSL_accept(ssl) : SSL_connect(ssl);
+        if (r == 1)
+            return true;
+        int err = SSL_get_error(ssl, r);
+        short events = err == SSL_ERROR_WANT_READ ? POLLIN : err == SSL_ERROR_WANT_WRITE ? POLLOUT : 0;
+        if (!events || millis() - start > HOST_CONNECT_TIMEOUT) {
+            ERR_clear_error();
+            return false;
+        }
+        struct pollfd p = {fd, events, 0};
+        poll(&p, 1, 10);
+    }
+}
+
+WiFiClientSecure::Tls::~Tls() {
+    SSL_shutdown(ssl);  // Send close_notify. Session not closed this way is removed from cache
+    ERR_clear_error();
+    SSL_free(ssl);
+}
+
+int WiFiClientSecure::connect(IPAddress ip, uint16_t port) {
+    stop();
+    if (!WiFiClient::connect(ip, port))
+        return 0;
+    SSL_CTX* ctx = tlsContext(TLS_client_method());
+    if (!ctx) {
+        stop();
+        return 0;
+    }
+    if (_insecure || _knownKey)
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+    else if (_ta)
+        tlsTrust(ctx, _ta, SSL_VERIFY_PEER);
+    else
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);  // Nothing to trust, fails as BearSSL does
+    if (_cert)
+        tlsCertificate(ctx, _cert, _sk);
+    SSL* ssl = SSL_new(ctx);
+    SSL_CTX_free(ctx);  // Referenced by ssl
+    if (!ssl) {
+        stop();
+        return 0;
+    }
+    _tls = std::make_shared<Tls>(ssl);
+    SSL_set_fd(ssl, fd());
+    if (_sslSession && _sslSession->get())
+        SSL_set_session(ssl, _sslSession->get());
+    if (!tlsHandshake(ssl, fd(), false)) {
+        stop();
+        return 0;
+    }
+    if (!_insecure && _knownKey) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        X509* peer = SSL_get1_peer_certificate(ssl);
+        bool match = peer && EVP_PKEY_eq(X509_get0_pubkey(peer), _knownKey->get()) == 1;
+#else
+        X509* peer = SSL_get_peer_certificate(ssl);
+        bool match = peer && EVP_PKEY_cmp(X509_get0_pubkey(peer), _knownKey->get()) == 1;
+#endif
+        X509_free(peer);
+        if (!match) {
+            stop();
+            return 0;
+        }
+    }
+    if (_sslSession)
+        _sslSession->set(SSL_get1_session(ssl));
+    return 1;
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port) {
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip))
+        return 0;
+    return connect(ip, port);
+}
+
+bool WiFiClientSecure::isResumed() {
+    return _tls && SSL_session_reused(_tls->ssl);
+}
+
+bool WiFiClientSecure::failed(int result) {
+    if (result > 0)
+        return false;
+    int err = SSL_get_error(_tls->ssl, result);
+    if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+        _tls->closed = true;
+        ERR_clear_error();
+    }
+    return true;
+}
+
+uint8_t WiFiClientSecure::connected() {
+    if (!_tls)
+        return 0;
+    if (SSL_pending(_tls->ssl) > 0)
+        return 1;
+    return !_tls->closed && WiFiClient::connected();
+}
+
+int WiFiClientSecure::available() {
+    if (!_tls)
+        return 0;
+    int count = SSL_pending(_tls->ssl);
+    if (count > 0)
+        return count;
+    // Decrypt next record if it's arrived. It's read from socket record by record, so data left
+    // in socket is reported by poll()/epoll as usual.
+    uint8_t c;
+    if (failed(SSL_peek(_tls->ssl, &c, 1)))
+        return 0;
+    count = SSL_pending(_tls->ssl);
+    return count > 0 ? count : 1;
+}
+
+int WiFiClientSecure::read(uint8_t* buffer, size_t size) {
+    if (!_tls)
+        return -1;
+    int r = SSL_read(_tls->ssl, buffer, size);
+    return failed(r) ? -1 : r;
+}
+
+int WiFiClientSecure::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClientSecure::peek() {
+    uint8_t c;
+    if (!_tls || failed(SSL_peek(_tls->ssl, &c, 1)))
+        return -1;
+    return c;
+}
+
+size_t WiFiClientSecure::write(const uint8_t* buffer, size_t size) {
+    if (!_tls || !size)
+        return 0;
+    // Never blocks. Partial write mode, caller retries with the rest of data (moved in its buffer)
+    SSL_set_mode(_tls->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    size_t sent = 0;
+    while (sent < size) {
+        int r = SSL_write(_tls->ssl, buffer + sent, size - sent);
+        if (r > 0) {
+            sent += r;
+            continue;
+        }
+        int err = SSL_get_error(_tls->ssl, r);
+        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            _tls->closed = true;
+        ERR_clear_error();
+        break;
+    }
+    return sent;
+}
+
+void WiFiClientSecure::stop() {
+    _tls.reset();
+    WiFiClient::stop();
+}
+
+WiFiServerSecure::~WiFiServerSecure() {
+    SSL_CTX_free(_ctx);
+}
+
+bool WiFiServerSecure::context() {
+    if (_ctx)
+        return true;
+    _ctx = tlsContext(TLS_server_method());
+    if (!_ctx)
+        return false;
+    if (!tlsCertificate(_ctx, _chain, _sk)) {
+        fprintf(stderr, "WiFiServerSecure: no certificate or key\n");
+        SSL_CTX_free(_ctx);
+        _ctx = nullptr;
+        return false;
+    }
+    if (_clientCA)
+        tlsTrust(_ctx, _clientCA, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT);
+    if (_cache && _cache->size()) {
+        static const unsigned char sid[] = "ModbusTLS";
+        SSL_CTX_set_session_id_context(_ctx, sid, sizeof(sid) - 1);
+        SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(_ctx, _cache->size());
+    } else {
+        SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_OFF);
+    }
+    return true;
+}
+
+WiFiClientSecure WiFiServerSecure::available() {
+    WiFiClient client = WiFiServer::available();
+    if (client.fd() < 0 || !context())
+        return WiFiClientSecure();
+    SSL* ssl = SSL_new(_ctx);
+    if (!ssl)
+        return WiFiClientSecure();
+    WiFiClientSecure secure(client, ssl);
+    SSL_set_fd(ssl, client.fd());
+    if (!tlsHandshake(ssl, client.fd(), true))
+        return WiFiClientSecure();
+    return secure;
+}
+#endif
@@ -0,0 +1,115 @@
+/*
+    Arduino core shim for native (Linux) builds
+    WiFiClientSecure backed by OpenSSL
+
+    Follows ESP8266 core BearSSL API (X509List, PrivateKey, PublicKey, Session, ServerSessions)
+    so ModbusTLS builds as for ESP8266. As with BearSSL only TLS 1.2 is negotiated and sessions
+    are resumed by session id (no tickets). Handshake is blocking, data transfer is not.
+
+    Optional part of the shim: build with -D HOST_TLS and link with -lssl -lcrypto.
+*/
+#pragma once
+#if !defined(HOST_TLS)
+#error "TLS on host requires -D HOST_TLS and -lssl -lcrypto"
+#endif
+#include "WiFi.h"
+#include <vector>
+#include <openssl/ssl.h>
+
+namespace BearSSL {
+
+class X509List {
+    public:
+    X509List(const char* pem);
+    ~X509List();
+    size_t getCount() const { return _certs.size(); }
+    X509* get(size_t i) const { return _certs[i]; }
+    private:
+    std::vector<X509*> _certs;
+};
+
+class PrivateKey {
+    public:
+    PrivateKey(const char* pem);
+    ~PrivateKey();
+    EVP_PKEY* get() const { return _key; }
+    private:
+    EVP_PKEY* _key = nullptr;
+};
+
+class PublicKey {
+    public:
+    PublicKey(const char* pem);
+    ~PublicKey();
+    EVP_PKEY* get() const { return _key; }
+    private:
+    EVP_PKEY* _key = nullptr;
+};
+
+// Parameters of established session. Filled by WiFiClientSecure::connect(), used on next connect() to resume
+class Session {
+    public:
+    Session() {}
+    ~Session() { set(nullptr); }
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    SSL_SESSION* get() const { return _session; }
+    void set(SSL_SESSION* session);    // Takes ownership of reference
+    private:
+    SSL_SESSION* _session = nullptr;
+};
+
+// Server side session cache size. Cache itself is kept in server SSL context
+class ServerSessions {
+    public:
+    ServerSessions(uint32_t size) : _size(size) {}
+    uint32_t size() const { return _size; }
+    private:
+    uint32_t _size;
+};
+
+}
+
+class WiFiClientSecure : public WiFiClient {
+    public:
+    WiFiClientSecure() {}
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    uint8_t connected();
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size);
+    int peek() override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void stop();
+    // As in ESP8266 core only setInsecure() clears other server authentication settings. Insecure mode takes
+    // precedence over known key, known key over trust anchors
+    void setInsecure() { clearAuthentication(); _insecure = true; }
+    void setTrustAnchors(const BearSSL::X509List* ta) { _ta = ta; }
+    void setClientRSACert(const BearSSL::X509List* cert, const BearSSL::PrivateKey* sk) { _cert = cert; _sk = sk; }
+    void setKnownKey(const BearSSL::PublicKey* pk) { _knownKey = pk; }
+    void setSession(BearSSL::Session* session) { _sslSession = session; }
+    void setBufferSizes(int /*recv*/, int /*xmit*/) {}  // OpenSSL buffers are not limited
+    bool isResumed();   // Last handshake was abbreviated
+    operator bool() { return connected(); }
+    private:
+    friend class WiFiServerSecure;
+    struct Tls {
+        SSL* ssl;
+        bool closed = false;    // close_notify received or fatal error
+        Tls(SSL* s) : ssl(s) {}
+        ~Tls();
+    };
+    std::shared_ptr<Tls> _tls;  // Shared by copies as socket is
+    bool _insecure = false;
+    const BearSSL::X509List* _ta = nullptr;
+    const BearSSL::X509List* _cert = nullptr;
+    const BearSSL::PrivateKey* _sk = nullptr;
+    const BearSSL::PublicKey* _knownKey = nullptr;
+    BearSSL::Session* _sslSession = nullptr;
+    WiFiClientSecure(const WiFiClient& client, SSL* ssl) : WiFiClient(client), _tls(std::make_shared<Tls>(ssl)) {}
+    bool failed(int result);    // Check SSL_read/SSL_peek result, marks connection closed on error
+    void clearAuthentication() { _insecure = false; _ta = nullptr; _knownKey = nullptr; }
+};
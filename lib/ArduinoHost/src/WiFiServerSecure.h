@@ -0,0 +1,24 @@
+/*
+    Arduino core shim for native (Linux) builds
+    WiFiServerSecure backed by OpenSSL, ESP8266 core API. See WiFiClientSecure.h
+*/
+#pragma once
+#include "WiFiClientSecure.h"
+
+class WiFiServerSecure : public WiFiServer {
+    public:
+    WiFiServerSecure(uint16_t port = 443) : WiFiServer(port) {}
+    ~WiFiServerSecure();
+    void setRSACert(const BearSSL::X509List* chain, const BearSSL::PrivateKey* sk) { _chain = chain; _sk = sk; }
+    void setClientTrustAnchor(const BearSSL::X509List* client_CA_ta) { _clientCA = client_CA_ta; }
+    void setCache(BearSSL::ServerSessions* cache) { _cache = cache; }
+    WiFiClientSecure available();   // Accepts pending connection and completes handshake
+    WiFiClientSecure accept() { return available(); }
+    private:
+    const BearSSL::X509List* _chain = nullptr;
+    const BearSSL::PrivateKey* _sk = nullptr;
+    const BearSSL::X509List* _clientCA = nullptr;
+    BearSSL::ServerSessions* _cache = nullptr;
+    SSL_CTX* _ctx = nullptr;    // Created on first connection, keeps session cache
+    bool context();
+};
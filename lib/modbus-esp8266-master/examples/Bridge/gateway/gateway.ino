@@ -0,0 +1,61 @@
+/*
+  ModbusRTU ESP8266/ESP32
+  ModbusTCP to ModbusRTU gateway serving any count of ModbusTCP clients at once
+
+  Requests of all clients are queued and sent to ModbusRTU bus one by one as soon as previous
+  response is got, so the bus is kept busy instead of replying EX_SLAVE_DEVICE_BUSY to everyone
+  but the first client. Responses are routed back by connection and transaction id.
+  
+  This code is licensed under the BSD New License. See LICENSE.txt for more info.
+  https://github.com/emelianov/modbus-esp8266
+*/
+#ifdef ESP8266
+ #include <ESP8266WiFi.h>
+#else //ESP32
+ #include <WiFi.h>
+#endif
+#include <ModbusTCP.h>
+#include <ModbusRTU.h>
+#include <ModbusGateway.h>
+
+ModbusRTU rtu;
+ModbusTCP tcp;
+ModbusGateway<ModbusTCP> gateway(tcp);
+
+void setup() {
+  Serial.begin(115000);
+  WiFi.begin("SSID", "PASSWORD");
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+  Serial.println("");
+  Serial.println("WiFi connected");
+  Serial.println("IP address: ");
+  Serial.println(WiFi.localIP());
+
+  tcp.server(); // Initialize ModbusTCP to process as server
+  tcp.addHreg(0, 0); // Local register served for unit ids not forwarded to the bus
+#if defined(ESP8266)
+  Serial1.begin(9600, SERIAL_8N1);
+#elif defined(ESP32)
+  Serial1.begin(9600, SERIAL_8N1, 18, 19);
+#endif
+  rtu.begin(&Serial1);
+  rtu.master();
+  gateway.addBus(rtu, 1, 247); // Forward requests to unit ids 1..247 to ModbusRTU slaves with the same id
+  gateway.queueTimeout(2000); // Reply EX_DEVICE_FAILED_TO_RESPOND to requests waiting for the bus longer than 2 sec
+  gateway.cacheTtl(1, 500); // Answer repeated reads of slave 1 from responses got within 500 mS
+}
+
+void loop() {
+  gateway.task(); // Calls tcp.task() and rtu.task()
+  static uint32_t last = millis();
+  if (millis() - last > 10000) {
+    last = millis();
+    auto& s = gateway.stats();
+    Serial.printf("Forwarded: %u Coalesced: %u Cached: %u Failed: %u Busy: %u Expired: %u Queue max: %u\n",
+                  s.forwarded, s.coalesced, s.cached, s.failed, s.rejected, s.expired, s.queuedMax);
+  }
+  yield();
+}
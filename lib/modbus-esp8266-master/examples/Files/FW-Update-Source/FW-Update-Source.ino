@@ -31,7 +31,7 @@ WebServer web(80);
 #define UPDATE_ENABLE 301
 #define UPDATE_FILE 301
 #define SLAVE_ID 1
-#define BLOCK_SIZE 64
+#define BLOCK_SIZE MODBUS_MAX_FILE_WRITE // Words per request. Largest block fitting the frame keeps bus busy with data rather than turnarounds
 
 uint32_t written = 0;
 bool updating = false;
@@ -0,0 +1,51 @@
+/*
+  Modbus Library for Arduino Example - Modbus RTU File records server - ESP32
+  Serves read-only data partition (memory mapped flash) as file records 1.. and RAM buffer as
+  writable file 100. Records are copied straight between storage and Modbus frame.
+  
+  This code is licensed under the BSD New License. See LICENSE.txt for more info.
+  https://github.com/emelianov/modbus-esp8266
+*/
+#include <ModbusRTU.h>
+#include <ModbusFileStore.h>
+#include <esp_partition.h>
+
+#define SLAVE_ID 1
+#define PARTITION_LABEL "spiffs" // Any data partition of partition table
+#define FIRST_FILE 1
+#define RAM_FILE 100
+
+ModbusRTU rtu;
+ModbusFileStore store;
+uint8_t ram[ModbusFileStore::FILE_SIZE / 4]; // Records 0..2499 of RAM_FILE
+
+void setup() {
+  Serial.begin(115200);
+  Serial1.begin(115200, SERIAL_8N1, 18, 19);
+  rtu.begin(&Serial1);
+  rtu.server(SLAVE_ID);
+
+  const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+  const void* data = nullptr;
+  if (part) {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_mmap_handle_t handle;
+    esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &data, &handle);
+#else
+    spi_flash_mmap_handle_t handle;
+    esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &data, &handle);
+#endif
+  }
+  if (data) { // Each file number covers 20000 bytes, so 1MB partition is files 1..53
+    store.map(FIRST_FILE, (const uint8_t*)data, part->size);
+    Serial.printf("Partition %s: %u bytes mapped to files %u..%u\n", PARTITION_LABEL, part->size,
+                  FIRST_FILE, FIRST_FILE + (part->size - 1) / ModbusFileStore::FILE_SIZE);
+  }
+  store.map(RAM_FILE, ram, sizeof(ram));
+  rtu.onFile(store.handler());
+}
+
+void loop() {
+  rtu.task();
+  yield();
+}
@@ -10,6 +10,7 @@
 */
 
 #include <ModbusRTU.h>
+#include <ModbusRequestQueue.h>
 
 #define REG 0
 #define REG_NUM 32
@@ -21,30 +22,14 @@
 #define MBUS_RXD_PIN   35
 
 ModbusRTU mb;
-
-xSemaphoreHandle xMutex;
-Modbus::ResultCode err;
+ModbusRequestQueue<ModbusRTU> queue(mb);  // Requests of all tasks are sent by busTask one by one
 
 Modbus::ResultCode readSync(uint8_t address, uint16_t start, uint16_t num, uint16_t* buf) {
-  xSemaphoreTake(xMutex, portMAX_DELAY);
-  if (mb.slave()) {
-    xSemaphoreGive(xMutex);
-    return Modbus::EX_GENERAL_FAILURE;
-  }
-  Serial.printf("SlaveID: %d Hreg %d\r\n", address, start);
-  mb.readIreg(address, start, buf, num, [](Modbus::ResultCode event, uint16_t, void*) {
-    err = event;
-    return true;
-  });
-  while (mb.slave()) {
-    vTaskDelay(1);
-    mb.task();
-  }
-  Modbus::ResultCode res = err;
-  xSemaphoreGive(xMutex);
-  return res;
+  Serial.printf("SlaveID: %d Ireg %d\r\n", address, start);
+  return queue.read(address, IREG(start), buf, num);  // Blocks calling task only
 }
 
+void busTask( void * pvParameters );
 void loop1( void * pvParameters );
 void loop2( void * pvParameters );
 
@@ -53,7 +38,14 @@ void setup() {
   MBUS_HW_SERIAL.begin(9600, SERIAL_8N1, MBUS_RXD_PIN, MBUS_TXD_PIN);
   mb.begin(&MBUS_HW_SERIAL);
   mb.master();
-  xMutex = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(
+                    busTask,     /* Task function. */
+                    "Modbus",    /* name of task. */
+                    10000,       /* Stack size of task */
+                    NULL,        /* parameter of the task */
+                    5,           /* priority of the task */
+                    NULL,        /* Task handle to keep track of created task */
+                    1);          /* pin task to core 1 */
   xTaskCreatePinnedToCore(
                     loop1,   /* Task function. */
                     "Task1",     /* name of task. */
@@ -74,6 +66,13 @@ void setup() {
 
 }
 
+void busTask( void * pvParameters ){  // The only task accessing mb
+  while(true) {
+      queue.task(10);  // Sleeps up to 10 ms if there is nothing to send or receive
+      vTaskDelay(1);
+  }
+}
+
 uint16_t hregs1[REG_NUM];
 void loop1( void * pvParameters ){
   while(true) {
@@ -0,0 +1,52 @@
+/*
+  Modbus Library for Arduino Example - Modbus RTU Client
+  Poll alarms every 100 ms and totals every 10 s from Modbus RTU Server
+  ESP32 Example
+
+  This code is licensed under the BSD New License. See LICENSE.txt for more info.
+  https://github.com/emelianov/modbus-esp8266
+*/
+
+#include <ModbusRTU.h>
+#include <ModbusPoller.h>
+
+#define SLAVE_ID 1
+
+ModbusRTU mb;
+ModbusPoller<uint8_t> poller;   // Single request on the bus at once
+
+bool alarms[8];
+uint16_t totals[6];
+int16_t alarmGroup;
+int16_t totalGroup;
+
+void setup() {
+  Serial.begin(115200);
+  Serial1.begin(9600, SERIAL_8N1);
+  mb.begin(&Serial1);
+  mb.master();
+
+  alarmGroup = poller.group(100, 1);
+  for (uint8_t i = 0; i < 8; i++)
+    poller.add(alarmGroup, SLAVE_ID, COIL(i), &alarms[i]);  // Read as single request
+
+  totalGroup = poller.group(10000, 0, [](uint8_t group) {  // Called on each completed scan
+    for (uint8_t i = 0; i < 6; i++)
+      if (poller.plan(group).result(i) == Modbus::EX_SUCCESS)
+        Serial.println(totals[i]);
+  });
+  for (uint8_t i = 0; i < 6; i++)
+    poller.add(totalGroup, SLAVE_ID, HREG(100 + i * 20), &totals[i]);
+}
+
+void loop() {
+  mb.task();
+  poller.task(mb);
+  static uint32_t report = 0;
+  if (millis() - report > 60000) {
+    report = millis();
+    const ModbusPoller<uint8_t>::Stats& s = poller.stats(alarmGroup);
+    Serial.printf("Alarms: scans %u, missed %u, jitter max %u ms\n", s.scans, s.missed, s.jitterMax);
+  }
+  yield();
+}
@@ -0,0 +1,62 @@
+/*
+  Modbus Library for Arduino Example - Modbus IP Client (ESP8266/ESP32)
+  Read Holding Registers from two Modbus Servers at once with futures
+
+  This code is licensed under the BSD New License. See LICENSE.txt for more info.
+  https://github.com/emelianov/modbus-esp8266
+*/
+
+#ifdef ESP8266
+ #include <ESP8266WiFi.h>
+#elif defined(ESP32)
+ #include <WiFi.h>
+#else
+#error "Unsupported platform"
+#endif
+#include <ModbusTCP.h>
+
+const int REG = 528;               // Modbus Hreg Offset
+IPAddress remote1(192, 168, 30, 13);  // Address of first Modbus Slave device
+IPAddress remote2(192, 168, 30, 14);  // Address of second Modbus Slave device
+
+ModbusTCP mb;  //ModbusTCP object
+
+void setup() {
+  Serial.begin(115200);
+ 
+  WiFi.begin("SSID", "PASSWORD");
+  
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+ 
+  Serial.println("");
+  Serial.println("WiFi connected");  
+  Serial.println("IP address: ");
+  Serial.println(WiFi.localIP());
+
+  mb.client();
+  mb.connect(remote1);
+  mb.connect(remote2);
+}
+
+uint16_t res1 = 0;
+uint16_t res2 = 0;
+ModbusFuture copy;
+
+void loop() {
+  if (copy.ready()) {   // Previous copy is done
+    ModbusFuture r1 = mb.readAsync(remote1, HREG(REG), &res1);  // Both requests are in progress at once
+    ModbusFuture r2 = mb.readAsync(remote2, HREG(REG), &res2);
+    if (mb.wait(r1) == Modbus::EX_SUCCESS && mb.wait(r2) == Modbus::EX_SUCCESS) {  // No global error variable
+      Serial.println(res1 + res2);
+      // Write sum to first server. Continuation is called from task() once it's done
+      copy = mb.writeAsync(remote1, HREG(REG + 1), (uint16_t)(res1 + res2)).then([](Modbus::ResultCode event) {
+        Serial.printf("Write result: 0x%02X\n", event);
+      });
+    }
+  }
+  mb.task();
+  delay(10);
+}
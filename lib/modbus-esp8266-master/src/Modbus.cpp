@@ -49,24 +49,24 @@ uint16_t Modbus::callback(TRegister* reg, uint16_t val, TCallback::CallbackType
 TRegister* Modbus::searchRegister(TAddress address) {
 #define MODBUS_COMPARE_REG [address](TRegister& addr){return (addr.address == address);}
 #if defined(MODBUS_USE_STL)
-    std::vector<TRegister>::iterator it = std::find_if(_regs.begin(), _regs.end(), MODBUS_COMPARE_REG);
-    if (it != _regs.end()) return &*it;
+    std::vector<TRegister>::iterator it = std::find_if(_bank->begin(), _bank->end(), MODBUS_COMPARE_REG);
+    if (it != _bank->end()) return &*it;
 #else
-    size_t r = _regs.find(MODBUS_COMPARE_REG);
-    if (r < _regs.size()) return _regs.entry(r); 
+    size_t r = _bank->find(MODBUS_COMPARE_REG);
+    if (r < _bank->size()) return _bank->entry(r); 
 #endif
     return nullptr;
 }
 
 bool Modbus::addReg(TAddress address, uint16_t value, uint16_t numregs) {
    #if defined(MODBUS_MAX_REGS)
-    if (_regs.size() + numregs > MODBUS_MAX_REGS) return false;
+    if (_bank->size() + numregs > MODBUS_MAX_REGS) return false;
    #endif
     if (0xFFFF - address.address < numregs)
         numregs = 0xFFFF - address.address;
     for (uint16_t i = 0; i < numregs; i++) {
         if (!searchRegister(address + i))
-            _regs.push_back({address + i, value});
+            _bank->push_back({address + i, value});
     }
     //std::sort(_regs.begin(), _regs.end());
     return true;
@@ -111,9 +111,9 @@ bool Modbus::removeReg(TAddress address, uint16_t numregs) {
             removeOnSet(address + i);
             removeOnGet(address + i);
             #if defined(MODBUS_USE_STL)
-            _regs.erase(std::remove( _regs.begin(), _regs.end(), *reg), _regs.end() );
+            _bank->erase(std::remove( _bank->begin(), _bank->end(), *reg), _bank->end() );
             #else
-            _regs.remove(_regs.find(MODBUS_COMPARE_REG));
+            _bank->remove(_bank->find(MODBUS_COMPARE_REG));
             #endif
         }
     }
@@ -295,30 +295,30 @@ void Modbus::slavePDU(uint8_t* frame) {
         break;
     #if defined(MODBUS_FILES)
         case FC_READ_FILE_REC:
-            if (frame[1] < 0x07 || frame[1] > 0xF5) {   // Wrong request data size
+            if (frame[1] < 0x07 || frame[1] > 0xF5 || frame[1] % 7) {   // Wrong request data size
                 exceptionResponse(fcode, EX_ILLEGAL_VALUE);
                 return;  
             }
             {
-            uint8_t bufSize = 2;    // 2 bytes for frame header
+            // Response data length is single byte up to 0xF5, so size is checked before each addition
+            const uint16_t maxSize = MODBUS_MAX_FRAME < 0xF5 + 2 ? MODBUS_MAX_FRAME : 0xF5 + 2;
+            uint16_t bufSize = 2;    // 2 bytes for frame header
             uint8_t* recs = frame + 2;   // Begin of sub-recs blocks
             uint8_t recsCount = frame[1] / 7; // Count of sub-rec blocks
             for (uint8_t p = 0; p < recsCount; p++) {   // Calc output buffer size required
-                //uint16_t fileNum = (uint16_t)recs[1] << 8 | (uint16_t)recs[2];
                 uint16_t recNum = (uint16_t)recs[3] << 8 | (uint16_t)recs[4];
                 uint16_t recLen = (uint16_t)recs[5] << 8 | (uint16_t)recs[6];
-                //Serial.printf("%d, %d, %d\n", fileNum, recNum, recLen);
-                if (recs[0] != 0x06 || recNum > 0x270F) { // Wrong ref type or count of records
+                if (recs[0] != 0x06 || recNum > MODBUS_MAX_FILES || (uint32_t)recNum + recLen > MODBUS_MAX_FILES + 1) { // Wrong ref type or records out of file
                     exceptionResponse(fcode, EX_ILLEGAL_ADDRESS);
                     return;
-                }  
-                bufSize += recLen * 2 + 2;   // 4 bytes for header + data
+                }
+                if (!recLen || bufSize + 2 + (uint32_t)recLen * 2 > maxSize) {   // Response doesn't fit frame
+                    exceptionResponse(fcode, EX_ILLEGAL_VALUE);
+                    return;
+                }
+                bufSize += recLen * 2 + 2;   // 2 bytes for header + data
                 recs += 7;
             }
-//            if (bufSize > MODBUS_MAX_FRAME) {  // Frame to return too large
-//                exceptionResponse(fcode, EX_ILLEGAL_ADDRESS);
-//                return;  
-//            }
             uint8_t* srcFrame = _frame;
             _frame = (uint8_t*)malloc(bufSize);
             if (!_frame) {
@@ -345,7 +345,7 @@ void Modbus::slavePDU(uint8_t* frame) {
                 recs += 7;
             }
             _frame[0] = fcode;
-            _frame[1] = bufSize;
+            _frame[1] = bufSize - 2;
             _reply = REPLY_NORMAL;
             free(srcFrame);
             }
@@ -356,16 +356,17 @@ void Modbus::slavePDU(uint8_t* frame) {
                 return;  
             }
             uint8_t* recs = frame + 2;   // Begin of sub-recs blocks
-            while (recs < frame + frame[1]) {
-                if (recs[0] != 0x06) {
-                    exceptionResponse(fcode, EX_ILLEGAL_ADDRESS);
-                    return;  
-                }
+            uint8_t* eoFrame = frame + 2 + frame[1];
+            while (recs + 7 <= eoFrame) {
                 uint16_t fileNum = (uint16_t)recs[1] << 8 | (uint16_t)recs[2];
                 uint16_t recNum = (uint16_t)recs[3] << 8 | (uint16_t)recs[4];
                 uint16_t recLen = (uint16_t)recs[5] << 8 | (uint16_t)recs[6];
-                if (recs + recLen * 2 > frame + frame[1]) {
+                if (recs[0] != 0x06 || recNum > MODBUS_MAX_FILES || (uint32_t)recNum + recLen > MODBUS_MAX_FILES + 1) {
                     exceptionResponse(fcode, EX_ILLEGAL_ADDRESS);
+                    return;  
+                }
+                if (!recLen || recs + 7 + recLen * 2 > eoFrame) {   // Data is shorter than record length
+                    exceptionResponse(fcode, EX_ILLEGAL_VALUE);
                     return;
                 }
                 ResultCode res = fileOp(fcode, fileNum, recNum, recLen, recs + 7);
@@ -790,23 +791,30 @@ void Modbus::masterPDU(uint8_t* frame, uint8_t* sourceFrame, TAddress startreg,
     #if defined(MODBUS_FILES)
         case FC_READ_FILE_REC:
         // Should check if byte order swap needed
-            if (frame[1] < 0x07 || frame[1] > 0xF5) {   // Wrong request data size
+            if (frame[1] < 0x04 || frame[1] > 0xF5) {   // Wrong response data size
                 _reply = EX_ILLEGAL_VALUE;
                 return;  
             }
             {
+            // Sub-responses are matched to sub-requests sent, so no more than requested is copied to output
             uint8_t* data = frame + 2;
-            uint8_t* eoFrame = frame + frame[1];
-            while (data < eoFrame) {
-                //data[0] - sub-req length
+            uint8_t* eoFrame = frame + 2 + frame[1];
+            uint8_t* req = sourceFrame + 2;
+            uint8_t* eoReq = sourceFrame + 2 + sourceFrame[1];
+            while (req + 7 <= eoReq) {
+                //data[0] - sub-resp length (reference type and data)
                 //data[1] = 0x06
-                if (data[1] != 0x06 || data[0] < 0x07 || data[0] > 0xF5 || data + data[0] > eoFrame) {   // Wrong request data size
-                    _reply = EX_ILLEGAL_VALUE;
+                uint16_t recLen = (uint16_t)req[5] << 8 | (uint16_t)req[6];
+                if (data + 2 > eoFrame || data[1] != 0x06 || data[0] != recLen * 2 + 1 || data + 1 + data[0] > eoFrame) {   // Wrong response data size
+                    _reply = EX_DATA_MISMACH;
                     return;  
                 }
-                memcpy(output, data + 2, data[0]);
+                if (output) {
+                    memcpy(output, data + 2, recLen * 2);
+                    output += recLen * 2;
+                }
                 data += data[0] + 1;
-                output += data[0] - 1;
+                req += 7;
             }
             }
         break;
@@ -124,9 +124,9 @@ class Modbus {
             EX_ILLEGAL_VALUE        = 0x03, // Output Value not in Range
             EX_SLAVE_FAILURE        = 0x04, // Slave or Master Device Fails to process request
             EX_ACKNOWLEDGE          = 0x05, // Not used
-            EX_SLAVE_DEVICE_BUSY    = 0x06, // Not used
+            EX_SLAVE_DEVICE_BUSY    = 0x06, // ModbusTCP rate limit exceeded
             EX_MEMORY_PARITY_ERROR  = 0x08, // Not used
-            EX_PATH_UNAVAILABLE     = 0x0A, // Not used
+            EX_PATH_UNAVAILABLE     = 0x0A, // ModbusTCP unit id without register bank
             EX_DEVICE_FAILED_TO_RESPOND = 0x0B, // Not used
             EX_GENERAL_FAILURE      = 0xE1, // Custom. Unexpected master error
             EX_DATA_MISMACH         = 0xE2, // Custom. Inpud data size mismach
@@ -220,6 +220,11 @@ class Modbus {
             REPLY_UNEXPECTED     = 0x05
         };
         #if defined(MODBUS_USE_STL)
+        typedef std::vector<TRegister> TRegisters;
+        #else
+        typedef DArray<TRegister, 1, 1> TRegisters;
+        #endif
+        #if defined(MODBUS_USE_STL)
         #if defined(MODBUS_GLOBAL_REGS)
         static std::vector<TRegister> _regs;
         static std::vector<TCallback> _callbacks;
@@ -249,6 +254,7 @@ class Modbus {
         #endif
         #endif
 
+        TRegisters* _bank = &_regs;  // Registers used by register API and requests processing. _regs unless other bank selected
         uint8_t*  _frame = nullptr;
         uint16_t  _len = 0;
         uint8_t   _reply = 0;
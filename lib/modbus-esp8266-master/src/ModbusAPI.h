@@ -6,6 +6,7 @@
 */
 #pragma once
 #include "Modbus.h"
+#include "ModbusFuture.h"
 
 template <class T>
 class ModbusAPI : public T {
@@ -133,8 +134,214 @@ class ModbusAPI : public T {
 	uint16_t rawResponce(TYPEID ip, uint8_t* data, uint16_t len, uint8_t unit = MODBUSIP_UNIT);
 	template <typename TYPEID>
 	uint16_t errorResponce(TYPEID ip, Modbus::FunctionCode fn, Modbus::ResultCode excode, uint8_t unit = MODBUSIP_UNIT);
+
+#if defined(MODBUS_USE_STL)
+	// Future API
+	void task();	// Protocol processing, then continuations of completed futures
+	// Send request with callback completing future. request is called with cbTransaction and returns transaction id,
+	// e.g. [&](cbTransaction cb) { return mb.readHreg(ip, 0, buf, 10, cb); }
+	template <typename REQUEST>
+	ModbusFuture async(REQUEST request);
+	template <typename TYPEID>
+	ModbusFuture readAsync(TYPEID id, TAddress reg, uint16_t* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return async([&](cbTransaction cb) { return read(id, reg, value, numregs, cb, unit); });
+	}
+	template <typename TYPEID>
+	ModbusFuture readAsync(TYPEID id, TAddress reg, bool* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return async([&](cbTransaction cb) { return read(id, reg, value, numregs, cb, unit); });
+	}
+	template <typename TYPEID>
+	ModbusFuture writeAsync(TYPEID id, TAddress reg, uint16_t value, uint8_t unit = MODBUSIP_UNIT) {
+		return async([&](cbTransaction cb) { return write(id, reg, value, cb, unit); });
+	}
+	template <typename TYPEID>
+	ModbusFuture writeAsync(TYPEID id, TAddress reg, bool value, uint8_t unit = MODBUSIP_UNIT) {
+		return async([&](cbTransaction cb) { return write(id, reg, value, cb, unit); });
+	}
+	template <typename TYPEID>
+	ModbusFuture writeAsync(TYPEID id, TAddress reg, uint16_t* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return async([&](cbTransaction cb) { return write(id, reg, value, numregs, cb, unit); });
+	}
+	template <typename TYPEID>
+	ModbusFuture writeAsync(TYPEID id, TAddress reg, bool* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return async([&](cbTransaction cb) { return write(id, reg, value, numregs, cb, unit); });
+	}
+	// Call task() till future is completed. For code running in the same thread as task() loop
+	Modbus::ResultCode wait(ModbusFuture f);
+	private:
+	std::vector<std::shared_ptr<ModbusFuture::State>> _completed;	// Futures with continuation to run at end of task()
+#endif
+#if defined(MODBUSAPI_CACHE)
+	public:
+	// Response cache
+	void cacheTtl(uint32_t ms) { _cacheTtl = ms; }	// 0 disables cache
+	template <typename TYPEID>
+	void cacheInvalidate(TYPEID id, TAddress reg, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT);	// E.g. slave is known to change values
+	void cacheClear() { _cache.clear(); _cacheGen++; }
+	uint32_t cacheHits() { return _cacheHits; }
+	uint32_t cacheMisses() { return _cacheMisses; }
+	private:
+	struct TCacheEntry {
+		uint32_t idKey;
+		uint8_t unit;
+		TAddress::RegType type;
+		uint16_t address;
+		std::vector<uint16_t> values;
+		uint32_t stamp;	// millis() of response
+	};
+	std::vector<TCacheEntry> _cache;
+	std::vector<cbTransaction> _cacheDone;	// Callbacks of reads answered from cache, called from task()
+	uint32_t _cacheTtl = MODBUSAPI_CACHE_TTL;
+	uint32_t _cacheGen = 0;	// Incremented on each invalidation. Response to read sent before is not cached
+	uint32_t _cacheHits = 0;
+	uint32_t _cacheMisses = 0;
+	static uint32_t cacheKey(uint32_t id) { return id; }	// Slave id or IP address
+	static uint32_t cacheKey(const char* host) { return 0; }	// Host names are not cached
+	static uint32_t cacheKey(const String& host) { return 0; }
+	// Copy cached values and return transaction id if found. Otherwise wrap cb to save response
+	template <typename TYPEID, typename VALTYPE>
+	uint16_t cacheRead(TYPEID id, TAddress reg, VALTYPE* value, uint16_t numregs, cbTransaction& cb, uint8_t unit);
+	template <typename VALTYPE>
+	void cacheStore(uint32_t idKey, uint8_t unit, TAddress reg, const VALTYPE* value, uint16_t numregs);
+	void cacheDrop(uint32_t idKey, uint8_t unit, TAddress reg, uint16_t numregs);
+	template <typename TYPEID>
+	void cacheWrite(TYPEID id, Modbus::FunctionCode fn, uint16_t offset, uint16_t numregs, uint8_t unit);
+#endif
 };
 
+#if defined(MODBUS_USE_STL)
+template <class T>
+void ModbusAPI<T>::task() {
+	T::task();
+#if defined(MODBUSAPI_CACHE)
+	if (!_cacheDone.empty()) {
+		std::vector<cbTransaction> done;
+		done.swap(_cacheDone);
+		for (auto& cb : done)
+			cb(Modbus::EX_SUCCESS, MODBUSAPI_CACHE_ID, nullptr);
+	}
+#endif
+	while (!_completed.empty()) {
+		std::vector<std::shared_ptr<ModbusFuture::State>> completed;
+		completed.swap(_completed);	// Continuations may send requests which complete on later task() calls
+		for (auto& s : completed) {
+			ModbusFuture::cbResult then;
+			then.swap(s->then);
+			if (then)
+				then(s->result);
+		}
+	}
+}
+
+template <class T>
+template <typename REQUEST>
+ModbusFuture ModbusAPI<T>::async(REQUEST request) {
+	auto s = std::make_shared<ModbusFuture::State>();
+	s->transactionId = request([this, s](Modbus::ResultCode event, uint16_t, void*) {
+		s->result = event;
+		s->done = true;
+		if (s->then)
+			_completed.push_back(s);	// Frame processing is in progress, continuation is deferred
+		return true;
+	});
+	if (!s->transactionId)
+		s->done = true;	// Not sent, callback will not be called
+	return ModbusFuture(s);
+}
+
+template <class T>
+Modbus::ResultCode ModbusAPI<T>::wait(ModbusFuture f) {
+	while (!f.ready()) {
+		task();
+		if (!f.ready())
+			yield();
+	}
+	return f.result();
+}
+#endif
+
+#if defined(MODBUSAPI_CACHE)
+template <class T>
+template <typename TYPEID, typename VALTYPE>
+uint16_t ModbusAPI<T>::cacheRead(TYPEID id, TAddress reg, VALTYPE* value, uint16_t numregs, cbTransaction& cb, uint8_t unit) {
+	uint32_t idKey = cacheKey(id);
+	if (!_cacheTtl || !value || !idKey)
+		return 0;
+	uint32_t now = millis();
+	for (TCacheEntry& e : _cache) {
+		if (e.idKey != idKey || e.unit != unit || e.type != reg.type || now - e.stamp >= _cacheTtl
+			|| reg.address < e.address || reg.address + numregs > e.address + e.values.size())
+			continue;
+		for (uint16_t i = 0; i < numregs; i++)
+			value[i] = e.values[reg.address - e.address + i];
+		_cacheHits++;
+		if (cb)
+			_cacheDone.push_back(cb);
+		return MODBUSAPI_CACHE_ID;
+	}
+	_cacheMisses++;
+	uint32_t gen = _cacheGen;
+	cbTransaction userCb = cb;
+	cb = [this, idKey, unit, reg, value, numregs, gen, userCb](Modbus::ResultCode event, uint16_t transactionId, void* data) {
+		if (event == Modbus::EX_SUCCESS && gen == _cacheGen)
+			cacheStore(idKey, unit, reg, value, numregs);
+		return userCb ? userCb(event, transactionId, data) : true;
+	};
+	return 0;
+}
+
+template <class T>
+template <typename VALTYPE>
+void ModbusAPI<T>::cacheStore(uint32_t idKey, uint8_t unit, TAddress reg, const VALTYPE* value, uint16_t numregs) {
+	cacheDrop(idKey, unit, reg, numregs);	// Overlapping ranges are older
+	if (_cache.size() >= MODBUSAPI_CACHE) {
+		size_t oldest = 0;
+		for (size_t i = 1; i < _cache.size(); i++)
+			if ((int32_t)(_cache[i].stamp - _cache[oldest].stamp) < 0)
+				oldest = i;
+		_cache.erase(_cache.begin() + oldest);
+	}
+	_cache.push_back({idKey, unit, reg.type, reg.address, std::vector<uint16_t>(value, value + numregs), millis()});
+}
+
+template <class T>
+void ModbusAPI<T>::cacheDrop(uint32_t idKey, uint8_t unit, TAddress reg, uint16_t numregs) {
+	for (size_t i = 0; i < _cache.size();) {
+		TCacheEntry& e = _cache[i];
+		if (e.idKey == idKey && e.unit == unit && e.type == reg.type
+			&& reg.address < e.address + e.values.size() && reg.address + numregs > e.address)
+			_cache.erase(_cache.begin() + i);
+		else
+			i++;
+	}
+}
+
+template <class T>
+template <typename TYPEID>
+void ModbusAPI<T>::cacheInvalidate(TYPEID id, TAddress reg, uint16_t numregs, uint8_t unit) {
+	_cacheGen++;
+	cacheDrop(cacheKey(id), unit, reg, numregs);
+}
+
+template <class T>
+template <typename TYPEID>
+void ModbusAPI<T>::cacheWrite(TYPEID id, Modbus::FunctionCode fn, uint16_t offset, uint16_t numregs, uint8_t unit) {
+	switch (fn) {
+	case Modbus::FC_WRITE_COIL:
+	case Modbus::FC_WRITE_COILS:
+		cacheInvalidate(id, COIL(offset), numregs, unit);
+		break;
+	default:
+		cacheInvalidate(id, HREG(offset), numregs, unit);
+	}
+}
+#define CACHEREAD(REG) { uint16_t hit = cacheRead(ip, REG(offset), value, numregs, cb, unit); if (hit) return hit; }
+#define CACHEWRITE(FUNC, OFFSET, NUMREGS) cacheWrite(ip, Modbus::FUNC, OFFSET, NUMREGS, unit);
+#else
+#define CACHEREAD(REG) ;
+#define CACHEWRITE(FUNC, OFFSET, NUMREGS) ;
+#endif
+
 // FNAME	writeCoil, writeIsts, writeHreg, writeIreg
 // REG		COIL, ISTS, HREG, IREG
 // FUNC		Modbus function
@@ -145,6 +352,7 @@ class ModbusAPI : public T {
 template <class T> \
 template <typename TYPEID> \
 uint16_t ModbusAPI<T>::FNAME(TYPEID ip, uint16_t offset, VALTYPE value, cbTransaction cb, uint8_t unit) { \
+	CACHEWRITE(FUNC, offset, 1) \
 	this->readSlave(offset, VALUE(value), Modbus::FUNC); \
 	return this->send(ip, REG(offset), cb, unit); \
 }
@@ -156,6 +364,7 @@ template <class T> \
 template <typename TYPEID> \
 uint16_t ModbusAPI<T>::FNAME(TYPEID ip, uint16_t offset, VALTYPE* value, uint16_t numregs, cbTransaction cb, uint8_t unit) { \
 	if (numregs < 0x0001 || numregs > MAXNUM) return false; \
+	CACHEWRITE(FUNC, offset, numregs) \
 	this->VALUE(REG(offset), offset, numregs, Modbus::FUNC, value); \
 	return this->send(ip, REG(offset), cb, unit); \
 }
@@ -167,6 +376,7 @@ template <class T> \
 template <typename TYPEID> \
 uint16_t ModbusAPI<T>::FNAME(TYPEID ip, uint16_t offset, VALTYPE* value, uint16_t numregs, cbTransaction cb, uint8_t unit) { \
 	if (numregs < 0x0001 || numregs > MAXNUM) return false; \
+	CACHEREAD(REG) \
 	this->readSlave(offset, numregs, Modbus::FUNC); \
 	return this->send(ip, REG(offset), cb, unit, (uint8_t*)value); \
 }
@@ -202,6 +412,7 @@ template <typename TYPEID> \
 uint16_t ModbusAPI<T>::FNAME(TYPEID ip, uint16_t to, uint16_t from, uint16_t numregs, cbTransaction cb, uint8_t unit) { \
 	if (numregs < 0x0001 || numregs > MAXNUM) return false; \
 	if (!this->searchRegister(REG(from))) return false; \
+	CACHEWRITE(FUNC, to, numregs) \
 	this->FINT(REG(from), to, numregs, Modbus::FUNC); \
 	return this->send(ip, REG(from), cb, unit); \
 }
@@ -410,20 +621,21 @@ bool ModbusAPI<T>::removeOnSetIreg(uint16_t offset, cbModbus cb, uint16_t numreg
 template <class T> \
 template <typename TYPEID> \
 uint16_t ModbusAPI<T>::readFileRec(TYPEID slaveId, uint16_t fileNum, uint16_t startRec, uint16_t len, uint8_t* data, cbTransaction cb, uint8_t unit) {
-	if (startRec > MODBUS_MAX_FILES) return 0;
+	if (startRec > MODBUS_MAX_FILES || !len || len > MODBUS_MAX_FILE_READ || startRec + len > MODBUS_MAX_FILES + 1) return 0;
 	if (!this->readSlaveFile(&fileNum, &startRec, &len, 1, Modbus::FC_READ_FILE_REC)) return 0;
 	return this->send(slaveId, NULLREG, cb, unit, data);
 };
 template <class T> \
 template <typename TYPEID> \
 uint16_t ModbusAPI<T>::writeFileRec(TYPEID slaveId, uint16_t fileNum, uint16_t startRec, uint16_t len, uint8_t* data, cbTransaction cb, uint8_t unit) {
-	if (startRec > MODBUS_MAX_FILES) return 0;
+	if (startRec > MODBUS_MAX_FILES || !len || len > MODBUS_MAX_FILE_WRITE || startRec + len > MODBUS_MAX_FILES + 1) return 0;
 	if (!this->writeSlaveFile(&fileNum, &startRec, &len, 1, Modbus::FC_WRITE_FILE_REC, data)) return 0;
 	return this->send(slaveId, NULLREG, cb, unit);
 };
 template <class T> \
 template <typename TYPEID> \
-uint16_t ModbusAPI<T>::maskHreg(TYPEID slaveId, uint16_t offset, uint16_t andMask, uint16_t orMask, cbTransaction cb, uint8_t unit) {
+uint16_t ModbusAPI<T>::maskHreg(TYPEID ip, uint16_t offset, uint16_t andMask, uint16_t orMask, cbTransaction cb, uint8_t unit) {
+	CACHEWRITE(FC_MASKWRITE_REG, offset, 1)
 	free(this->_frame);
 	this->_len = 7;
 	this->_frame = (uint8_t*) malloc(this->_len);
@@ -434,7 +646,7 @@ uint16_t ModbusAPI<T>::maskHreg(TYPEID slaveId, uint16_t offset, uint16_t andMas
 	this->_frame[4] = andMask & 0x00FF;
 	this->_frame[5] = orMask >> 8;
 	this->_frame[6] = orMask & 0x00FF;
-	return this->send(slaveId, HREG(offset), cb, unit);	
+	return this->send(ip, HREG(offset), cb, unit);	
 };
 
 template <class T> \
@@ -445,6 +657,7 @@ uint16_t ModbusAPI<T>::readWriteHreg(TYPEID ip, \
 			cbTransaction cb, uint8_t unit) {
 	const uint8_t _header = 10;
 	if (readNumregs < 0x0001 || readNumregs > MODBUS_MAX_WORDS || writeNumregs < 0x0001 || writeNumregs > 0X0079 || !readValue || !writeValue) return 0;
+	CACHEWRITE(FC_READWRITE_REGS, writeOffset, writeNumregs)
 
 	free(this->_frame);
 	this->_len = _header + 2 * writeNumregs;
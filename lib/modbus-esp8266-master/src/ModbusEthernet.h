@@ -10,6 +10,7 @@
 #endif
 #include "ModbusAPI.h"
 #include "ModbusTCPTemplate.h"
+#include "ModbusRTUTCPTemplate.h"
 #if defined(ARDUINO_PORTENTA_H7_M4) || defined(ARDUINO_PORTENTA_H7_M7) || defined(ARDUINO_PORTENTA_X8)
 #define MODBUS_ETH_WRAP_ACCEPT
 #undef MODBUS_ETH_WRAP_BEGIN
@@ -57,3 +58,6 @@ class ModbusEthernet : public ModbusAPI<ModbusTCPTemplate<EthernetServerWrapper,
     }
 #endif
 };
+
+// Modbus RTU framing over TCP (no MBAP, CRC kept)
+class ModbusRTUEthernet : public ModbusAPI<ModbusRTUTCPTemplate<EthernetServerWrapper, EthernetClient>> {};
@@ -0,0 +1,109 @@
+/*
+    Modbus Library for Arduino
+	File record (0x14/0x15) backing store. Serves records from memory or stdio file
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+#pragma once
+#include "Modbus.h"
+#if defined(MODBUS_FILES) && defined(MODBUS_USE_STL)
+#include <stdio.h>
+#include <vector>
+
+// Storage area (RAM buffer, memory mapped flash partition, file) is mapped to consecutive file numbers starting
+// from firstFile, MODBUS_MAX_FILES + 1 records (word each) per file. Records are read and written straight
+// from/to the frame buffer passed to onFile() handler, no intermediate buffer is used.
+// Set as handler with mb.onFile(store.handler())
+class ModbusFileStore {
+	public:
+	static const uint32_t FILE_SIZE = (MODBUS_MAX_FILES + 1) * 2;	// Bytes per file number
+	// Read-only memory, e.g. flash partition mapped with esp_partition_mmap()
+	bool map(uint16_t firstFile, const uint8_t* data, uint32_t size) { return add(firstFile, size, data, nullptr, nullptr, false); }
+	// Writable memory
+	bool map(uint16_t firstFile, uint8_t* data, uint32_t size) { return add(firstFile, size, data, data, nullptr, true); }
+	// Open stdio file (ESP32 VFS or host file), size is bytes served. Writes are not flushed till fflush()/fclose()
+	bool map(uint16_t firstFile, FILE* file, uint32_t size, bool writable = false) { return add(firstFile, size, nullptr, nullptr, file, writable); }
+	bool unmap(uint16_t firstFile);
+	void clear() { _areas.clear(); }
+	Modbus::ResultCode operator()(Modbus::FunctionCode fn, uint16_t fileNum, uint16_t recNum, uint16_t recLen, uint8_t* frame);
+	cbModbusFileOp handler() {
+		return [this](Modbus::FunctionCode fn, uint16_t fileNum, uint16_t recNum, uint16_t recLen, uint8_t* frame) {
+			return (*this)(fn, fileNum, recNum, recLen, frame);
+		};
+	}
+	private:
+	struct TArea {
+		uint16_t first;
+		uint16_t last;	// Last file number
+		uint32_t size;
+		const uint8_t* rd;
+		uint8_t* wr;
+		FILE* file;
+		bool writable;
+	};
+	std::vector<TArea> _areas;
+	bool add(uint16_t firstFile, uint32_t size, const uint8_t* rd, uint8_t* wr, FILE* file, bool writable);
+};
+
+inline bool ModbusFileStore::add(uint16_t firstFile, uint32_t size, const uint8_t* rd, uint8_t* wr, FILE* file, bool writable) {
+	if (!firstFile || !size || (!rd && !file))
+		return false;
+	uint32_t last = firstFile + (size - 1) / FILE_SIZE;
+	if (last > UINT16_MAX)
+		return false;
+	for (const TArea& a : _areas)
+		if (a.first <= last && a.last >= firstFile)	// File numbers overlap
+			return false;
+	_areas.push_back({firstFile, (uint16_t)last, size, rd, wr, file, writable});
+	return true;
+}
+
+inline bool ModbusFileStore::unmap(uint16_t firstFile) {
+	for (auto it = _areas.begin(); it != _areas.end(); it++) {
+		if (it->first == firstFile) {
+			_areas.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+inline Modbus::ResultCode ModbusFileStore::operator()(Modbus::FunctionCode fn, uint16_t fileNum, uint16_t recNum, uint16_t recLen, uint8_t* frame) {
+	if (fn != Modbus::FC_READ_FILE_REC && fn != Modbus::FC_WRITE_FILE_REC)
+		return Modbus::EX_ILLEGAL_FUNCTION;
+	for (const TArea& a : _areas) {
+		if (fileNum < a.first || fileNum > a.last)
+			continue;
+		uint32_t offset = (fileNum - a.first) * FILE_SIZE + recNum * 2;
+		uint32_t len = recLen * 2;
+		if (offset >= a.size)
+			return Modbus::EX_ILLEGAL_ADDRESS;
+		uint32_t avail = len;
+		if (offset + len > a.size) {
+			if (offset + len > a.size + 1)	// Only odd byte of area is allowed to be in last record
+				return Modbus::EX_ILLEGAL_ADDRESS;
+			avail = a.size - offset;
+		}
+		if (fn == Modbus::FC_READ_FILE_REC) {
+			if (avail < len)
+				frame[avail] = 0xFF;
+			if (a.rd) {
+				memcpy(frame, a.rd + offset, avail);
+				return Modbus::EX_SUCCESS;
+			}
+			if (fseek(a.file, offset, SEEK_SET) || fread(frame, 1, avail, a.file) != avail)
+				return Modbus::EX_SLAVE_FAILURE;
+			return Modbus::EX_SUCCESS;
+		}
+		if (!a.writable)
+			return Modbus::EX_ILLEGAL_ADDRESS;
+		if (a.wr) {
+			memcpy(a.wr + offset, frame, avail);
+			return Modbus::EX_SUCCESS;
+		}
+		if (fseek(a.file, offset, SEEK_SET) || fwrite(frame, 1, avail, a.file) != avail)
+			return Modbus::EX_SLAVE_FAILURE;
+		return Modbus::EX_SUCCESS;
+	}
+	return Modbus::EX_ILLEGAL_ADDRESS;
+}
+#endif
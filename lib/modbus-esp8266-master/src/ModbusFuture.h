@@ -0,0 +1,67 @@
+/*
+    Modbus Library for Arduino
+	Result handle of asynchronous client request
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+#pragma once
+#include "Modbus.h"
+#if defined(MODBUS_USE_STL)
+#include <memory>
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define MODBUS_COROUTINES
+#endif
+
+// Returned by ModbusAPI::async(), readAsync() and writeAsync(). Copies share the same state.
+// Request completes from task() on response, exception, timeout or disconnection. Continuation set by then()
+// (and coroutine waiting for the result) is run at end of task() call, outside of frame processing, so it may send next requests.
+class ModbusFuture {
+	public:
+	typedef std::function<void(Modbus::ResultCode)> cbResult;
+	ModbusFuture() {}
+	bool valid() const { return _s && _s->transactionId; }	// Request was sent
+	bool ready() const { return !_s || _s->done; }	// Request is completed or failed to send
+	Modbus::ResultCode result() const { return _s ? _s->result : Modbus::EX_GENERAL_FAILURE; }
+	uint16_t transactionId() const { return _s ? _s->transactionId : 0; }
+	// Set continuation. Called at once if request is already completed
+	ModbusFuture& then(cbResult cb) {
+		if (ready())
+			cb(result());
+		else
+			_s->then = cb;
+		return *this;
+	}
+	#if defined(MODBUS_COROUTINES)
+	// co_await mb.readAsync(...) suspends coroutine till request completes and returns result code
+	bool await_ready() const { return ready(); }
+	void await_suspend(std::coroutine_handle<> h) {
+		cbResult then = _s->then;	// Continuation set by then() is kept
+		_s->then = [then, h](Modbus::ResultCode result) { if (then) then(result); h.resume(); };
+	}
+	Modbus::ResultCode await_resume() const { return result(); }
+	#endif
+	private:
+	template <class T> friend class ModbusAPI;
+	struct State {
+		Modbus::ResultCode result = Modbus::EX_GENERAL_FAILURE;
+		uint16_t transactionId = 0;
+		bool done = false;
+		cbResult then;
+	};
+	std::shared_ptr<State> _s;
+	ModbusFuture(std::shared_ptr<State> s) : _s(s) {}
+};
+
+#if defined(MODBUS_COROUTINES)
+// Return type for application coroutines awaiting ModbusFuture. Starts at once, frame is freed on return
+struct ModbusCoroutine {
+	struct promise_type {
+		ModbusCoroutine get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() {}
+	};
+};
+#endif
+#endif
@@ -0,0 +1,521 @@
+/*
+    Modbus Library for Arduino
+	ModbusTCP to ModbusRTU gateway
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+#pragma once
+#include "ModbusRTU.h"
+#if defined(MODBUS_USE_STL)
+#include <deque>
+#include <memory>
+#include <algorithm>
+
+// Requests of any count of ModbusTCP clients are queued per ModbusRTU bus by unit id and sent to the bus one by one.
+// Each queued request keeps TCP connection id and transaction id, so response is sent back to the exact client
+// while requests of other clients keep arriving. Exception responses of slaves are forwarded as is, timeout
+// is replied with EX_DEVICE_FAILED_TO_RESPOND. Requests to unit ids not mapped to any bus are processed locally.
+// Broadcast writes are sent to all buses, broadcast reads are processed locally as well.
+// Read requests of the same unit and function overlapping or adjacent to a read already waiting for the bus are
+// merged into it, and a read contained in the range being read is attached to it, so single bus transaction
+// answers all of them (e.g. redundant SCADA servers polling the same slave).
+// Optionally successful read responses are kept for short time per unit (cacheTtl()) and repeated reads are
+// answered from memory. Cache of unit is bypassed while write to it is waiting and is updated once write is done.
+// TCP is ModbusTCP, ModbusTLS or ModbusEthernet object in server mode
+template <class TCP>
+class ModbusGateway {
+	public:
+	struct Stats {
+		uint32_t forwarded = 0;	// Requests sent to RTU buses
+		uint32_t coalesced = 0;	// Client requests answered by bus request sent for another one
+		uint32_t cached = 0;	// Client requests answered from cache
+		uint32_t failed = 0;	// Requests replied with EX_DEVICE_FAILED_TO_RESPOND (timeout, send failure)
+		uint32_t rejected = 0;	// Requests replied with EX_SLAVE_DEVICE_BUSY as queue is full
+		uint32_t expired = 0;	// Requests waited in queue longer than queue timeout
+		uint32_t dropped = 0;	// Requests and responses dropped as client connection is closed
+		uint16_t queuedMax = 0;	// Longest queue seen
+	};
+	ModbusGateway(TCP& tcp) : _tcp(tcp) {}
+	// Forward requests for units firstUnit..lastUnit to rtu. rtu is to be set to master mode. Returns bus index or -1
+	int16_t addBus(ModbusRTU& rtu, uint8_t firstUnit = 1, uint8_t lastUnit = 247);
+	void queueTimeout(uint32_t ms) { _queueTimeout = ms; }	// Max time request waits for the bus
+	void coalesce(bool enabled) { _coalesce = enabled; }	// Merge concurrent reads of the same registers, on by default
+	// Time read response is reused, ms. For all units not set individually or for the unit. 0 disables cache
+	void cacheTtl(uint32_t ms) { _cacheTtl = ms; }
+	void cacheTtl(uint8_t unit, uint32_t ms);
+	void cacheClear() { _cache.clear(); }
+	size_t queued(uint8_t bus) { return bus < _buses.size() ? _buses[bus]->queue.size() : 0; }
+	const Stats& stats() { return _stats; }
+	// Call instead of tcp.task() and rtu.task()
+	void task();
+	private:
+	struct TClient {
+		uint32_t connection;
+		uint16_t transactionId;
+		uint16_t address;	// Registers requested by client if request is read
+		uint16_t count;
+	};
+	struct TJob {
+		uint8_t unit;
+		uint32_t queued;	// millis() request is received
+		bool single = false;	// Never merged with other requests
+		std::vector<uint8_t> pdu;
+		std::vector<TClient> clients;	// Empty for broadcast, no response is sent
+	};
+	struct TBus {
+		ModbusRTU* rtu;
+		uint8_t first;
+		uint8_t last;
+		std::deque<TJob> queue;
+		bool busy = false;	// Request is sent to the bus
+		bool done = false;	// Response or error is got
+		bool quiet = false;	// Broadcast is sent, bus is kept quiet for MODBUSGW_BROADCAST_DELAY
+		uint32_t broadcast;	// millis() broadcast is sent
+		TJob current;
+		Modbus::ResultCode result;
+		std::vector<uint8_t> response;
+	};
+	TCP& _tcp;
+	std::vector<std::unique_ptr<TBus>> _buses;
+	uint32_t _queueTimeout = MODBUSGW_QUEUE_TIMEOUT;
+	bool _coalesce = true;
+	struct TCacheEntry {
+		uint8_t unit;
+		uint16_t address;
+		uint16_t count;
+		uint32_t time;	// millis() response is got
+		std::vector<uint8_t> response;	// Function code is response[0]
+	};
+	std::vector<TCacheEntry> _cache;
+	uint32_t _cacheTtl = MODBUSGW_CACHE_TTL;
+	std::vector<std::pair<uint8_t, uint32_t>> _unitTtl;	// TTL of units set individually
+	Stats _stats;
+	static bool isRead(const std::vector<uint8_t>& pdu) {
+		return pdu.size() == 5 && pdu[0] >= Modbus::FC_READ_COILS && pdu[0] <= Modbus::FC_READ_INPUT_REGS;
+	}
+	// Length of normal response to write request (echo of request head), 0 if not write or malformed
+	static uint8_t writeEcho(const std::vector<uint8_t>& pdu) {
+		switch (pdu[0]) {
+		case Modbus::FC_WRITE_COIL:
+		case Modbus::FC_WRITE_REG:
+			return pdu.size() == 5 ? 5 : 0;
+		case Modbus::FC_WRITE_COILS:
+		case Modbus::FC_WRITE_REGS:
+			return pdu.size() >= 6 && pdu.size() == 6u + pdu[5] ? 5 : 0;
+		case Modbus::FC_MASKWRITE_REG:
+			return pdu.size() == 7 ? 7 : 0;
+		case Modbus::FC_WRITE_FILE_REC:
+			return pdu.size() >= 2 && pdu.size() == 2u + pdu[1] ? pdu.size() : 0;
+		}
+		return 0;
+	}
+	static bool isBits(uint8_t fn) { return fn == Modbus::FC_READ_COILS || fn == Modbus::FC_READ_INPUT_STAT; }
+	static uint16_t pduAddress(const std::vector<uint8_t>& pdu) { return (pdu[1] << 8) | pdu[2]; }
+	static uint16_t pduCount(const std::vector<uint8_t>& pdu) { return (pdu[3] << 8) | pdu[4]; }
+	Modbus::ResultCode tcpRaw(uint8_t* data, uint8_t len, Modbus::frame_arg_t* src);
+	Modbus::ResultCode rtuRaw(TBus* b, uint8_t* data, uint8_t len, Modbus::frame_arg_t* src);
+	bool enqueue(TBus* b, TJob& job);
+	bool merge(TBus* b, TJob& job);
+	uint32_t ttl(uint8_t unit);
+	bool cacheRead(TBus* b, const TJob& job);
+	void cacheStore(const TJob& job, const std::vector<uint8_t>& response);
+	void cacheDrop(const TJob& job);
+	bool slice(const std::vector<uint8_t>& r, uint16_t start, const TClient& c, std::vector<uint8_t>& pdu);
+	void start(TBus* b);
+	void finish(TBus* b);
+	void respond(const TClient& c, uint8_t unit, uint8_t* pdu, uint16_t len);
+	void exception(const TJob& job, Modbus::ResultCode code);
+};
+
+template <class TCP>
+int16_t ModbusGateway<TCP>::addBus(ModbusRTU& rtu, uint8_t firstUnit, uint8_t lastUnit) {
+	if (!firstUnit || firstUnit > lastUnit || _buses.size() >= INT16_MAX)
+		return -1;
+	_buses.emplace_back(new TBus);
+	TBus* b = _buses.back().get();
+	b->rtu = &rtu;
+	b->first = firstUnit;
+	b->last = lastUnit;
+	rtu.onRaw([this, b](uint8_t* data, uint8_t len, void* custom) {
+		return rtuRaw(b, data, len, (Modbus::frame_arg_t*)custom);
+	});
+	_tcp.onRaw([this](uint8_t* data, uint8_t len, void* custom) {
+		return tcpRaw(data, len, (Modbus::frame_arg_t*)custom);
+	});
+	return _buses.size() - 1;
+}
+
+template <class TCP>
+Modbus::ResultCode ModbusGateway<TCP>::tcpRaw(uint8_t* data, uint8_t len, Modbus::frame_arg_t* src) {
+	if (!src->to_server || !len)
+		return Modbus::EX_PASSTHROUGH;	// Response to own client request or empty frame
+	TJob job;
+	job.unit = src->unitId;
+	job.queued = millis();
+	job.pdu.assign(data, data + len);
+	TClient c = { _tcp.eventConnection(), src->transactionId, 0, 0 };
+	if (isRead(job.pdu)) {
+		c.address = pduAddress(job.pdu);
+		c.count = pduCount(job.pdu);
+	}
+	job.clients.push_back(c);
+	if (job.unit == MODBUSRTU_BROADCAST) {	// Write to all buses, no response is expected from slaves
+		uint8_t echo = writeEcho(job.pdu);
+		if (_buses.empty() || !echo)
+			return Modbus::EX_PASSTHROUGH;	// Read can't be broadcast, serve locally
+		job.clients.clear();
+		bool accepted = false;
+		for (auto& b : _buses)
+			accepted = enqueue(b.get(), job) || accepted;
+		if (accepted) {
+			respond(c, job.unit, data, echo);	// Normal write response
+		} else {
+			_stats.rejected++;
+			uint8_t pdu[2] = { (uint8_t)(data[0] | 0x80), Modbus::EX_SLAVE_DEVICE_BUSY };
+			respond(c, job.unit, pdu, sizeof(pdu));
+		}
+		return Modbus::EX_SUCCESS;
+	}
+	for (auto& b : _buses) {
+		if (job.unit < b->first || job.unit > b->last)
+			continue;
+		if (cacheRead(b.get(), job)) {
+			_stats.cached++;
+		} else if (_coalesce && merge(b.get(), job)) {
+			_stats.coalesced++;
+		} else if (!enqueue(b.get(), job)) {
+			_stats.rejected++;
+			exception(job, Modbus::EX_SLAVE_DEVICE_BUSY);
+		}
+		return Modbus::EX_SUCCESS;	// Stop local processing, response is sent by task()
+	}
+	return Modbus::EX_PASSTHROUGH;
+}
+
+template <class TCP>
+bool ModbusGateway<TCP>::enqueue(TBus* b, TJob& job) {
+	if (b->queue.size() >= MODBUSGW_QUEUE)
+		return false;
+	b->queue.push_back(job);
+	if (b->queue.size() > _stats.queuedMax)
+		_stats.queuedMax = b->queue.size();
+	return true;
+}
+
+template <class TCP>
+bool ModbusGateway<TCP>::merge(TBus* b, TJob& job) {
+	if (!isRead(job.pdu) || !job.clients[0].count)
+		return false;
+	const TClient& c = job.clients[0];
+	uint8_t fn = job.pdu[0];
+	uint32_t first = c.address;
+	uint32_t last = first + c.count;	// Past the end
+	uint32_t limit = isBits(fn) ? MODBUS_MAX_BITS : MODBUS_MAX_WORDS;
+	for (auto it = b->queue.rbegin(); it != b->queue.rend(); ++it) {
+		if (it->unit == MODBUSRTU_BROADCAST && !isRead(it->pdu))	// Nor broadcast write
+			return false;
+		if (it->unit != job.unit)
+			continue;
+		if (!isRead(it->pdu))	// Read may not pass write to the same unit queued earlier
+			return false;
+		if (it->single || it->pdu[0] != fn)
+			continue;
+		uint32_t start = pduAddress(it->pdu);
+		uint32_t end = start + pduCount(it->pdu);
+		if (first > end || last < start)	// Neither overlapping nor adjacent
+			continue;
+		start = std::min(start, first);
+		end = std::max(end, last);
+		if (end - start > limit)
+			continue;
+		it->pdu[1] = start >> 8;
+		it->pdu[2] = start & 0xFF;
+		it->pdu[3] = (end - start) >> 8;
+		it->pdu[4] = (end - start) & 0xFF;
+		it->clients.push_back(c);
+		return true;
+	}
+	// Request in progress can't be widened but may answer read it contains
+	TJob& cur = b->current;
+	if (!b->busy || b->done || cur.single || cur.unit != job.unit || !isRead(cur.pdu) || cur.pdu[0] != fn || cur.clients.empty())
+		return false;
+	if (first < pduAddress(cur.pdu) || last > (uint32_t)pduAddress(cur.pdu) + pduCount(cur.pdu))
+		return false;
+	cur.clients.push_back(c);
+	return true;
+}
+
+template <class TCP>
+Modbus::ResultCode ModbusGateway<TCP>::rtuRaw(TBus* b, uint8_t* data, uint8_t len, Modbus::frame_arg_t* src) {
+	if (src->to_server || !b->busy || b->done || src->slaveId != b->current.unit)
+		return Modbus::EX_PASSTHROUGH;
+	b->response.assign(data, data + len);	// Response or exception, forwarded as is
+	return Modbus::EX_SUCCESS;	// Not processed as response to local request. Transaction callback gets EX_SUCCESS
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::task() {
+	_tcp.task();
+	for (auto& bus : _buses) {
+		TBus* b = bus.get();
+		b->rtu->task();
+		if (b->busy && b->done) {
+			b->busy = false;
+			finish(b);
+		}
+		if (!b->busy)
+			start(b);
+	}
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::start(TBus* b) {
+	while (!b->queue.empty()) {
+		if (b->rtu->slave())	// Bus is used by application request
+			return;
+		if (b->quiet) {
+			if (millis() - b->broadcast < MODBUSGW_BROADCAST_DELAY)
+				return;
+			b->quiet = false;
+		}
+		TJob& job = b->queue.front();
+		if (!job.clients.empty()) {
+			auto closed = std::remove_if(job.clients.begin(), job.clients.end(), [this](const TClient& c) {
+				return !_tcp.connectionActive(c.connection);
+			});
+			_stats.dropped += job.clients.end() - closed;
+			job.clients.erase(closed, job.clients.end());
+			if (job.clients.empty()) {	// Nobody to respond to
+				b->queue.pop_front();
+				continue;
+			}
+		}
+		if (millis() - job.queued > _queueTimeout) {	// Clients have likely given up already
+			_stats.expired += job.clients.size();
+			exception(job, Modbus::EX_DEVICE_FAILED_TO_RESPOND);
+			b->queue.pop_front();
+			continue;
+		}
+		b->current = std::move(job);
+		b->queue.pop_front();
+		b->busy = true;
+		b->done = false;
+		b->response.clear();
+		_stats.forwarded++;
+		if (!b->rtu->rawRequest(b->current.unit, b->current.pdu.data(), b->current.pdu.size(), [b](Modbus::ResultCode event, uint16_t, void*) {
+				b->result = event;
+				b->done = true;
+				return true;
+			})) {
+			b->busy = false;
+			_stats.failed += b->current.clients.size();
+			exception(b->current, Modbus::EX_DEVICE_FAILED_TO_RESPOND);
+			continue;
+		}
+		if (b->done && b->current.clients.empty()) {	// Broadcast is completed once sent
+			b->busy = false;
+			b->quiet = true;
+			b->broadcast = millis();
+			cacheDrop(b->current);
+			continue;
+		}
+		return;
+	}
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::finish(TBus* b) {
+	TJob& job = b->current;
+	std::vector<uint8_t>& r = b->response;
+	if (!isRead(job.pdu))
+		cacheDrop(job);	// Even if write is refused or timed out, it may have been applied
+	if (b->result != Modbus::EX_SUCCESS || r.empty()) {
+		_stats.failed += job.clients.size();
+		exception(job, Modbus::EX_DEVICE_FAILED_TO_RESPOND);
+		return;
+	}
+	uint16_t start = isRead(job.pdu) ? pduAddress(job.pdu) : 0;
+	uint16_t n = isRead(job.pdu) ? pduCount(job.pdu) : 0;
+	if (n && !(r[0] & 0x80))
+		cacheStore(job, r);
+	std::vector<TClient> retry;
+	std::vector<uint8_t> pdu;
+	for (const TClient& c : job.clients) {
+		if (c.address == start && c.count == n) {	// Requested range is read, forward as is
+			respond(c, job.unit, r.data(), r.size());
+			continue;
+		}
+		if (r[0] & 0x80) {	// Merged range may be refused for registers client hasn't asked for
+			retry.push_back(c);
+			continue;
+		}
+		if (!slice(r, start, c, pdu)) {	// Response is shorter than requested
+			_stats.failed++;
+			pdu = { (uint8_t)(r[0] | 0x80), Modbus::EX_DEVICE_FAILED_TO_RESPOND };
+		}
+		respond(c, job.unit, pdu.data(), pdu.size());
+	}
+	for (auto it = retry.rbegin(); it != retry.rend(); ++it) {	// Resend own request of each client, keeping order
+		TJob one;
+		one.unit = job.unit;
+		one.queued = job.queued;
+		one.single = true;
+		one.pdu = { job.pdu[0], (uint8_t)(it->address >> 8), (uint8_t)(it->address & 0xFF), (uint8_t)(it->count >> 8), (uint8_t)(it->count & 0xFF) };
+		one.clients.push_back(*it);
+		b->queue.push_front(std::move(one));
+	}
+}
+
+template <class TCP>
+bool ModbusGateway<TCP>::slice(const std::vector<uint8_t>& r, uint16_t start, const TClient& c, std::vector<uint8_t>& pdu) {
+	bool bits = isBits(r[0]);
+	uint32_t offset = c.address - start;
+	uint32_t size = bits ? (offset + c.count + 7) / 8 : (offset + c.count) * 2;	// Response bytes client's range ends at
+	if (r.size() < 2 || r[1] < size || r.size() < 2 + size)
+		return false;
+	pdu.assign({ r[0], (uint8_t)(bits ? (c.count + 7) / 8 : c.count * 2) });
+	if (bits) {
+		pdu.resize(2 + pdu[1], 0);
+		for (uint16_t i = 0; i < c.count; i++)
+			if (r[2 + (offset + i) / 8] & (1 << ((offset + i) % 8)))
+				pdu[2 + i / 8] |= 1 << (i % 8);
+	} else {
+		pdu.insert(pdu.end(), r.begin() + 2 + offset * 2, r.begin() + 2 + (offset + c.count) * 2);
+	}
+	return true;
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::cacheTtl(uint8_t unit, uint32_t ms) {
+	for (auto& t : _unitTtl) {
+		if (t.first == unit) {
+			t.second = ms;
+			return;
+		}
+	}
+	_unitTtl.push_back({unit, ms});
+}
+
+template <class TCP>
+uint32_t ModbusGateway<TCP>::ttl(uint8_t unit) {
+	for (auto& t : _unitTtl)
+		if (t.first == unit)
+			return t.second;
+	return _cacheTtl;
+}
+
+template <class TCP>
+bool ModbusGateway<TCP>::cacheRead(TBus* b, const TJob& job) {
+	if (_cache.empty() || !isRead(job.pdu))
+		return false;
+	uint32_t t = ttl(job.unit);
+	if (!t)
+		return false;
+	auto pending = [&job](const TJob& j) { return (j.unit == job.unit || j.unit == MODBUSRTU_BROADCAST) && !isRead(j.pdu); };
+	if ((b->busy && pending(b->current)) || std::any_of(b->queue.begin(), b->queue.end(), pending))
+		return false;	// Cached values may be changed by write client has sent before
+	const TClient& c = job.clients[0];
+	for (auto& e : _cache) {
+		if (e.unit != job.unit || e.response[0] != job.pdu[0] || millis() - e.time >= t)
+			continue;
+		if (e.address > c.address || (uint32_t)c.address + c.count > (uint32_t)e.address + e.count)
+			continue;
+		std::vector<uint8_t> pdu;
+		if (!slice(e.response, e.address, c, pdu))
+			continue;
+		respond(c, job.unit, pdu.data(), pdu.size());
+		return true;
+	}
+	return false;
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::cacheStore(const TJob& job, const std::vector<uint8_t>& response) {
+	if (!MODBUSGW_CACHE || !ttl(job.unit))
+		return;
+	uint16_t a = pduAddress(job.pdu);
+	uint16_t n = pduCount(job.pdu);
+	TCacheEntry* slot = nullptr;
+	for (auto& e : _cache) {
+		if (e.unit == job.unit && e.response[0] == response[0] && e.address >= a && (uint32_t)e.address + e.count <= (uint32_t)a + n) {
+			slot = &e;	// Same or narrower range is replaced
+			break;
+		}
+	}
+	if (!slot && _cache.size() < MODBUSGW_CACHE) {
+		_cache.emplace_back();
+		slot = &_cache.back();
+	}
+	if (!slot) {	// Oldest one is replaced
+		slot = &_cache[0];
+		for (auto& e : _cache)
+			if ((int32_t)(e.time - slot->time) < 0)
+				slot = &e;
+	}
+	slot->unit = job.unit;
+	slot->address = a;
+	slot->count = n;
+	slot->time = millis();
+	slot->response = response;
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::cacheDrop(const TJob& job) {
+	uint8_t fn = job.pdu[0];
+	uint8_t table = 0;	// Function code reading registers write changes, 0 if unknown
+	uint32_t first = 0;
+	uint32_t last = UINT16_MAX;
+	if (job.pdu.size() >= 5) {
+		first = pduAddress(job.pdu);
+		switch (fn) {
+		case Modbus::FC_WRITE_COIL:
+			table = Modbus::FC_READ_COILS;
+			last = first;
+			break;
+		case Modbus::FC_WRITE_COILS:
+			table = Modbus::FC_READ_COILS;
+			last = first + pduCount(job.pdu) - 1;
+			break;
+		case Modbus::FC_WRITE_REG:
+		case Modbus::FC_MASKWRITE_REG:
+			table = Modbus::FC_READ_REGS;
+			last = first;
+			break;
+		case Modbus::FC_WRITE_REGS:
+			table = Modbus::FC_READ_REGS;
+			last = first + pduCount(job.pdu) - 1;
+			break;
+		case Modbus::FC_READWRITE_REGS:
+			if (job.pdu.size() >= 9) {
+				table = Modbus::FC_READ_REGS;
+				first = (job.pdu[5] << 8) | job.pdu[6];
+				last = first + ((job.pdu[7] << 8) | job.pdu[8]) - 1;
+			}
+			break;
+		}
+	}
+	if (!table) {	// Unknown function may change anything
+		first = 0;
+		last = UINT16_MAX;
+	}
+	_cache.erase(std::remove_if(_cache.begin(), _cache.end(), [&](const TCacheEntry& e) {
+		if (job.unit != MODBUSRTU_BROADCAST && e.unit != job.unit)
+			return false;
+		if (table && e.response[0] != table)
+			return false;
+		return e.address <= last && (uint32_t)e.address + e.count > first;
+	}), _cache.end());
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::respond(const TClient& c, uint8_t unit, uint8_t* pdu, uint16_t len) {
+	if (c.connection && !_tcp.sendResponse(c.connection, c.transactionId, unit, pdu, len))
+		_stats.dropped++;
+}
+
+template <class TCP>
+void ModbusGateway<TCP>::exception(const TJob& job, Modbus::ResultCode code) {
+	uint8_t pdu[2] = { (uint8_t)(job.pdu[0] | 0x80), (uint8_t)code };
+	for (const TClient& c : job.clients)
+		respond(c, job.unit, pdu, sizeof(pdu));
+}
+#endif
@@ -0,0 +1,137 @@
+/*
+    Modbus Library for Arduino
+	Multi-rate tag polling with earliest deadline first scheduling
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+#pragma once
+#include "ModbusReadPlan.h"
+#if defined(MODBUS_USE_STL)
+
+// Tags are polled in groups. Each group is released every period (ms) and has to be read before next release
+// (deadline). Read requests of released groups are sent in order of earliest deadline, priority breaks ties.
+// Scheduling is done per request, so long scan of slow group delays fast group by single request only.
+// On overload groups which already missed deadline yield to ones still in time and are ordered by priority,
+// so overload is taken by groups of lower priority instead of delaying all of them.
+// TYPEID is slave id (uint8_t) for ModbusRTU or IPAddress for ModbusTCP/ModbusTLS
+template <typename TYPEID>
+class ModbusPoller {
+	public:
+	typedef std::function<void(uint8_t group)> cbScan;
+	struct Stats {
+		uint32_t scans = 0;		// Completed scans
+		uint32_t missed = 0;	// Scans completed after deadline
+		uint32_t skipped = 0;	// Releases dropped as previous scan of the group has overrun whole period
+		uint32_t jitterMax = 0;	// Delay of scan start after release, ms
+		uint32_t jitterSum = 0;
+		uint32_t durationMax = 0;	// Scan time, ms
+		uint32_t jitterAvg() const { return scans ? jitterSum / scans : 0; }
+	};
+	// window is count of requests in progress at once over all groups. Keep 1 for ModbusRTU without MODBUSRTU_QUEUE.
+	ModbusPoller(uint16_t window = 1) : _window(window ? window : 1) {}
+	// Add group. Higher priority wins if deadlines are equal. Callback is called on each completed scan.
+	// Returns group index or -1
+	int16_t group(uint32_t period, uint8_t priority = 0, cbScan cb = nullptr) {
+		if (!period || _groups.size() >= UINT8_MAX)
+			return -1;
+		_groups.emplace_back(new TGroup);
+		TGroup* g = _groups.back().get();
+		g->period = period;
+		g->priority = priority;
+		g->cb = cb;
+		g->release = millis();
+		return _groups.size() - 1;
+	}
+	int16_t add(uint8_t group, TYPEID id, TAddress reg, uint16_t* value, uint8_t unit = MODBUSIP_UNIT) {
+		return group < _groups.size() ? _groups[group]->plan.add(id, reg, value, unit) : -1;
+	}
+	int16_t add(uint8_t group, TYPEID id, TAddress reg, bool* value, uint8_t unit = MODBUSIP_UNIT) {
+		return group < _groups.size() ? _groups[group]->plan.add(id, reg, value, unit) : -1;
+	}
+	// Read plan of group, e.g. to exclude() registers, set gap() or limit(), or check tag result()
+	ModbusReadPlan<TYPEID>& plan(uint8_t group) { return _groups[group]->plan; }
+	const Stats& stats(uint8_t group) { return _groups[group]->stats; }
+	void resetStats(uint8_t group) { _groups[group]->stats = Stats(); }
+	uint8_t groups() { return _groups.size(); }
+	// Call from loop() along with mb.task()
+	template <class MASTER>
+	void task(MASTER& mb);
+	private:
+	struct TGroup {
+		ModbusReadPlan<TYPEID> plan;
+		uint32_t period;
+		uint8_t priority;
+		cbScan cb;
+		uint32_t release;	// Current release time, deadline is release + period
+		uint32_t started;
+		bool scanning = false;
+		Stats stats;
+	};
+	std::vector<std::unique_ptr<TGroup>> _groups;	// Plan is referenced by requests in progress, so groups never move
+	uint16_t _window;
+	void completed(uint8_t i, uint32_t now);
+	bool before(const TGroup* a, const TGroup* b, uint32_t now) {	// a is to be served first
+		bool aLate = (int32_t)(now - (a->release + a->period)) > 0;
+		bool bLate = (int32_t)(now - (b->release + b->period)) > 0;
+		if (aLate != bLate)
+			return !aLate;
+		if (aLate && a->priority != b->priority)
+			return a->priority > b->priority;
+		int32_t d = (int32_t)((a->release + a->period) - (b->release + b->period));
+		return d < 0 || (d == 0 && a->priority > b->priority);
+	}
+};
+
+template <typename TYPEID>
+template <class MASTER>
+void ModbusPoller<TYPEID>::task(MASTER& mb) {
+	uint32_t now = millis();
+	uint16_t pending = 0;
+	for (uint8_t i = 0; i < _groups.size(); i++) {
+		TGroup* g = _groups[i].get();
+		if (g->scanning && g->plan.ready())
+			completed(i, now);
+		pending += g->plan.pending();
+	}
+	while (pending < _window) {
+		TGroup* next = nullptr;
+		for (auto& g : _groups) {
+			if (g->scanning ? !g->plan.remaining() : (int32_t)(now - g->release) < 0)	// Nothing to send or not released yet
+				continue;
+			if (!next || before(g.get(), next, now))
+				next = g.get();
+		}
+		if (!next)
+			break;
+		if (!next->scanning) {
+			uint32_t jitter = now - next->release;
+			next->stats.jitterSum += jitter;
+			if (jitter > next->stats.jitterMax)
+				next->stats.jitterMax = jitter;
+			next->started = now;
+			next->scanning = true;
+			next->plan.start();
+		}
+		if (next->plan.step(mb))
+			pending++;
+	}
+}
+
+template <typename TYPEID>
+void ModbusPoller<TYPEID>::completed(uint8_t i, uint32_t now) {
+	TGroup* g = _groups[i].get();
+	g->scanning = false;
+	g->stats.scans++;
+	if (now - g->started > g->stats.durationMax)
+		g->stats.durationMax = now - g->started;
+	if (now - g->release > g->period)
+		g->stats.missed++;
+	g->release += g->period;
+	if ((int32_t)(now - g->release) >= (int32_t)g->period) {	// Deadline of next release is passed as well
+		uint32_t n = (now - g->release) / g->period;
+		g->stats.skipped += n;
+		g->release += n * g->period;
+	}
+	if (g->cb)
+		g->cb(i);
+}
+#endif
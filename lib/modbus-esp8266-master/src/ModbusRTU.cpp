@@ -97,6 +97,9 @@ uint32_t ModbusRTUTemplate::calculateMinimumInterFrameTime(uint32_t baud, uint8_
 // Kept for backward compatibility
 void ModbusRTUTemplate::setBaudrate(uint32_t baud) {
     setInterFrameTime(calculateMinimumInterFrameTime(baud));
+#if defined(MODBUSRTU_FLUSH_DELAY) || defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+	_t1 = charSendTime(baud);
+#endif
 }
 
 void ModbusRTUTemplate::setInterFrameTime(uint32_t t_us) {
@@ -109,11 +112,28 @@ void ModbusRTUTemplate::setInterFrameTime(uint32_t t_us) {
     _t = t_us;
 }
 
+void ModbusRTUTemplate::rxPoll() {
+	uint16_t avail = _port->available();
+	if (avail <= _len)
+		return;
+	uint32_t now = micros();
+#if defined(MODBUSRTU_FRAME_STATS)
+	if (_len) {	// Inter-character gap (at task() polling resolution)
+		if (now - t > _gap) _gap = now - t;
+	} else {	// Start of new frame
+		_gap = 0;
+		_fragmentGap = now - t;
+	}
+#endif
+	_len = avail;
+	t = now;
+}
+
 bool ModbusRTUTemplate::begin(Stream* port, int16_t txEnablePin, bool txEnableDirect) {
     _port = port;
     _t = 1750UL;
-#if defined(MODBUSRTU_FLUSH_DELAY)
-	_t1 = charSendTime(0);
+#if defined(MODBUSRTU_FLUSH_DELAY) || defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+	_t1 = charSendTime(9600);	// Baudrate of Stream is unknown, assume slow one
 #endif
     if (txEnablePin >= 0) {
 	    _txEnablePin = txEnablePin;
@@ -153,6 +173,9 @@ bool ModbusRTUTemplate::rawSend(uint8_t slaveId, uint8_t* frame, uint8_t len) {
 #endif
 #if defined(ESP32)
 	vTaskDelay(0);
+#endif
+#if defined(MODBUSRTU_STATS)
+	_stamps.txStart = micros();
 #endif
     _port->write(slaveId);  	//Send slaveId
     _port->write(frame, len); 	// Send PDU
@@ -176,40 +199,84 @@ bool ModbusRTUTemplate::rawSend(uint8_t slaveId, uint8_t* frame, uint8_t len) {
 #endif
         digitalWrite(_txEnablePin, _direct?LOW:HIGH);
 	}
+#endif
+#if defined(MODBUSRTU_STATS)
+	_stamps.txEnd = micros();
 #endif
     return true;
 }
 
 uint16_t ModbusRTUTemplate::send(uint8_t slaveId, TAddress startreg, cbTransaction cb, uint8_t unit, uint8_t* data, bool waitResponse) {
     bool result = false;
-	if ((!isMaster || !_slaveId) && _len && _frame) { // Check if waiting for previous request result and _frame filled
-	//if (_len && _frame) { // Check if waiting for previous request result and _frame filled
-		rawSend(slaveId, _frame, _len);
-		if (waitResponse && slaveId) {
-        	_slaveId = slaveId;
-			_timestamp = micros();
-			_cb = cb;
-			_data = data;
-			_sentFrame = _frame;
-			_sentReg = startreg;
-			_frame = nullptr;
-		}
-		result = true;
-	}
-	free(_frame);
+	uint8_t* frame = _frame;	// Detached as callback of request without response may prepare next one
+	uint16_t len = _len;
 	_frame = nullptr;
 	_len = 0;
+	if (len && frame) {
+		if (!isMaster || !_slaveId) { // Check if waiting for previous request result
+			result = startRequest(slaveId, frame, len, startreg, cb, data, waitResponse);
+			frame = nullptr;
+		}
+#if defined(MODBUSRTU_QUEUE)
+		else if (_queue.size() < MODBUSRTU_QUEUE) { // Queue request to be sent on bus release
+			TRTURequest tmp;
+			tmp.slaveId = slaveId;
+			tmp.frame = frame;
+			tmp.len = len;
+			tmp.startreg = startreg;
+			tmp.cb = cb;
+			tmp.data = data;
+			tmp.waitResponse = waitResponse;
+			tmp.deadline = millis() + _deadline;
+			_queue.push_back(tmp);
+			frame = nullptr;
+			result = true;
+		}
+#endif
+	}
+	free(frame);
 	return result;
 }
 
+bool ModbusRTUTemplate::startRequest(uint8_t slaveId, uint8_t* frame, uint8_t len, TAddress startreg, cbTransaction cb, uint8_t* data, bool waitResponse) {
+	uint32_t timeout = MODBUSRTU_TIMEOUT_US;
+#if defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+	if (isMaster && waitResponse && slaveId) {
+		TRTUSlaveStat* s = slaveStat(slaveId);
+		if (s && s->fails >= MODBUSRTU_OFFLINE_COUNT) { // Let single probe request to offline slave to pass
+			if (micros() - s->probe < MODBUSRTU_PROBE_INTERVAL_US) {
+				free(frame);
+				if (cb)
+					cb(Modbus::EX_DEVICE_FAILED_TO_RESPOND, 0, nullptr);	// Completed without being sent
+				return true;
+			}
+			s->probe = micros();
+		}
+		timeout = this->timeout(slaveId, frame);
+	}
+#endif
+	rawSend(slaveId, frame, len);
+	if (waitResponse && slaveId) {
+		_slaveId = slaveId;
+		_timestamp = micros();
+		_timeout = timeout;
+		_cb = cb;
+		_data = data;
+		_sentFrame = frame;
+		_sentReg = startreg;
+		return true;
+	}
+	free(frame);
+	if (cb)
+		cb(Modbus::EX_SUCCESS, 0, nullptr);	// Broadcast is completed once sent
+	return true;
+}
+
 void ModbusRTUTemplate::task() {
 #if defined(ESP32)
 	vTaskDelay(0);
 #endif
-    if (_port->available() > _len) {
-        _len = _port->available();
-        t = micros();
-    }
+    rxPoll();
 	if (_len == 0) {
 		if (isMaster) cleanup();
 		return;
@@ -222,16 +289,30 @@ void ModbusRTUTemplate::task() {
 	else {	// For slave wait for whole message to come (unless MODBUSRTU_MAX_READMS reached)
 		uint32_t taskStart = micros();
     	while (micros() - t < _t) { // Wait data whitespace
-    		if (_port->available() > _len) {
-        		_len = _port->available();
-        		t = micros();
-			}
+    		rxPoll();
 			if (micros() - taskStart > MODBUSRTU_MAX_READ_US) { // Prevent from task() executed too long
 				return;
 			}
 		}
 	}
 
+#if defined(MODBUSRTU_FRAME_STATS)
+	_frameStats.frames++;
+	if (_gap > _t * 3 / 7) _frameStats.t15++;	// Inter-character gap over 1.5 char inside of frame
+	if (_gap > _frameStats.maxGap) _frameStats.maxGap = _gap;
+#endif
+	if (_len < 4 || _len > MODBUS_MAX_FRAME) {	// Truncated frame or overrun
+#if defined(MODBUSRTU_FRAME_STATS)
+		if (_len < 4) _frameStats.truncated++;
+		else _frameStats.overrun++;
+		frameError();
+#endif
+		for (uint16_t i=0 ; i < _len ; i++) _port->read();
+		_len = 0;
+		if (isMaster) cleanup();
+		return;
+	}
+
 	bool valid_frame = true;
     address = _port->read(); //first byte of frame = address
     _len--; // Decrease by slaveId byte
@@ -241,7 +322,12 @@ void ModbusRTUTemplate::task() {
     if (address != MODBUSRTU_BROADCAST && address != _slaveId) {     // SlaveId Check
 		valid_frame = false;
     }
-	if (!valid_frame && !_cbRaw) {
+#if defined(MODBUSRTU_FRAME_STATS)
+	bool skip = false;	// Frames to other slaves are read as well to check CRC
+#else
+	bool skip = !valid_frame && !_cbRaw;
+#endif
+	if (skip) {
         for (uint8_t i=0 ; i < _len ; i++) _port->read();   // Skip packet if SlaveId doesn't mach
         _len = 0;
 		if (isMaster) cleanup();
@@ -270,8 +356,15 @@ void ModbusRTUTemplate::task() {
     uint16_t frameCrc = ((_frame[_len - 2] << 8) | _frame[_len - 1]); // Last two byts = crc
     _len = _len - 2;    // Decrease by CRC 2 bytes
     if (frameCrc != crc16(address, _frame, _len)) {  // CRC Check
+#if defined(MODBUSRTU_FRAME_STATS)
+		_frameStats.crc++;
+		frameError();
+#endif
 		goto cleanup;
     }
+#if defined(MODBUSRTU_FRAME_STATS)
+	_badFrame = false;
+#endif
 	_reply = EX_PASSTHROUGH;
 	if (_cbRaw) {
 		frame_arg_t header_data = { address, !isMaster };
@@ -285,6 +378,9 @@ void ModbusRTUTemplate::task() {
 			// Procass incoming frame as master
 			if (_reply == EX_PASSTHROUGH || _reply == EX_FORCE_PROCESS)
 				masterPDU(_frame, _sentFrame, _sentReg, _data);
+#if defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+			responseReceived(_slaveId, micros() - _timestamp, _len + 3);
+#endif
             if (_cb) {
 			    _cb((ResultCode)_reply, 0, nullptr);
 				_cb = nullptr;
@@ -297,11 +393,20 @@ void ModbusRTUTemplate::task() {
         _reply = Modbus::REPLY_OFF;    // No reply if master
     } else {
 		if (_reply == EX_PASSTHROUGH || _reply == EX_FORCE_PROCESS) {
+#if defined(MODBUSRTU_STATS)
+			uint8_t fc = _len ? _frame[0] : 0;	// slavePDU() overwrites request with response
+			_stamps.rx = t;
+			_stamps.dispatch = micros();
+#endif
         	slavePDU(_frame);
         	if (address == MODBUSRTU_BROADCAST)
 				_reply = Modbus::REPLY_OFF;    // No reply for Broadcasts
-    		if (_reply != Modbus::REPLY_OFF)
+    		if (_reply != Modbus::REPLY_OFF) {
 				rawSend(address, _frame, _len);
+#if defined(MODBUSRTU_STATS)
+				latencyAdd(fc, _stamps.txStart - _stamps.rx);
+#endif
+			}
 		}
     }
     // Cleanup
@@ -313,8 +418,12 @@ cleanup:
 }
 
 bool ModbusRTUTemplate::cleanup() {
+	bool result = false;
 	// Remove timeouted request and forced event
-	if (_slaveId && (micros() - _timestamp > MODBUSRTU_TIMEOUT_US)) {
+	if (_slaveId && (micros() - _timestamp > _timeout)) {
+#if defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+		responseTimeout(_slaveId);
+#endif
 		if (_cb) {
 			_cb(Modbus::EX_TIMEOUT, 0, nullptr);
 			_cb = nullptr;
@@ -323,7 +432,245 @@ bool ModbusRTUTemplate::cleanup() {
         _sentFrame = nullptr;
         _data = nullptr;
 		_slaveId = 0;
-        return true;
+        result = true;
+	}
+#if defined(MODBUSRTU_QUEUE)
+	dispatch();
+#endif
+    return result;
+}
+
+#if defined(MODBUSRTU_QUEUE)
+size_t ModbusRTUTemplate::nextRequest() {
+	size_t next = 0;
+	switch (_schedule) {
+	case SCHEDULE_ROUND_ROBIN: {
+		// Closest slave id after last served one
+		uint8_t best = (uint8_t)(_queue[0].slaveId - _lastSlave - 1);
+		for (size_t i = 1; i < _queue.size(); i++) {
+			uint8_t d = (uint8_t)(_queue[i].slaveId - _lastSlave - 1);
+			if (d < best) {
+				best = d;
+				next = i;
+			}
+		}
+	}
+	break;
+	case SCHEDULE_DEADLINE: {
+		uint32_t now = millis();
+		int32_t best = (int32_t)(_queue[0].deadline - now);
+		for (size_t i = 1; i < _queue.size(); i++) {
+			int32_t d = (int32_t)(_queue[i].deadline - now);
+			if (d < best) {
+				best = d;
+				next = i;
+			}
+		}
 	}
-    return false;
-}
\ No newline at end of file
+	break;
+	default:
+	break;
+	}
+	return next;
+}
+
+void ModbusRTUTemplate::dispatch() {
+	while (!_slaveId && _queue.size()) {
+		size_t i = nextRequest();
+		TRTURequest r = _queue[i];
+		#if defined(MODBUS_USE_STL)
+		_queue.erase(_queue.begin() + i);
+		#else
+		_queue.remove(i);
+		#endif
+		_lastSlave = r.slaveId;
+		startRequest(r.slaveId, r.frame, r.len, r.startreg, r.cb, r.data, r.waitResponse);
+	}
+}
+
+void ModbusRTUTemplate::dropQueue() {
+	while (_queue.size()) {
+		TRTURequest r = _queue[0];
+		#if defined(MODBUS_USE_STL)
+		_queue.erase(_queue.begin());
+		#else
+		_queue.remove(0);
+		#endif
+		free(r.frame);
+		if (r.cb)
+			r.cb(Modbus::EX_CANCEL, 0, nullptr);
+	}
+}
+#endif
+
+#if defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+TRTUSlaveStat* ModbusRTUTemplate::slaveStat(uint8_t slaveId, bool create) {
+#define MODBUSRTU_COMPARE_STAT [slaveId](TRTUSlaveStat& s){return s.slaveId == slaveId;}
+	#if defined(MODBUS_USE_STL)
+	std::vector<TRTUSlaveStat>::iterator it = std::find_if(_stats.begin(), _stats.end(), MODBUSRTU_COMPARE_STAT);
+	if (it != _stats.end()) return &*it;
+	#else
+	TRTUSlaveStat* it = _stats.entry(_stats.find(MODBUSRTU_COMPARE_STAT));
+	if (it) return it;
+	#endif
+	if (!create) return nullptr;
+	TRTUSlaveStat tmp;
+	tmp.slaveId = slaveId;
+	_stats.push_back(tmp);
+	return slaveStat(slaveId);
+}
+
+uint32_t ModbusRTUTemplate::responseTime(uint8_t* frame) {
+	// Frame length of response = slaveId + PDU + CRC
+	uint16_t len = MODBUS_MAX_FRAME;
+	uint16_t count;
+	if (frame) {
+		switch (frame[0]) {	// Count (or read count for FC_READWRITE_REGS) is present only in read requests
+		case FC_READ_COILS:
+		case FC_READ_INPUT_STAT:
+			count = (uint16_t)frame[3] << 8 | frame[4];
+			len = 5 + count / 8 + (count % 8 ? 1 : 0);
+		break;
+		case FC_READ_REGS:
+		case FC_READ_INPUT_REGS:
+		case FC_READWRITE_REGS:
+			count = (uint16_t)frame[3] << 8 | frame[4];
+			len = 5 + count * 2;
+		break;
+		case FC_WRITE_COIL:
+		case FC_WRITE_REG:
+		case FC_WRITE_COILS:
+		case FC_WRITE_REGS:
+			len = 8;
+		break;
+		case FC_MASKWRITE_REG:
+			len = 10;
+		break;
+		default:
+		break;
+		}
+	}
+	// Response frame transmission time plus inter-frame gap
+	return len * _t1 + _t;
+}
+
+uint32_t ModbusRTUTemplate::timeout(uint8_t slaveId, uint8_t* frame) {
+	TRTUSlaveStat* s = slaveStat(slaveId);
+	if (!s || !s->srtt) // No response from slave so far
+		return MODBUSRTU_TIMEOUT_US;
+	uint32_t t = s->srtt + 4 * s->rttvar + responseTime(frame);
+	if (t < MODBUSRTU_TIMEOUT_MIN_US)
+		return MODBUSRTU_TIMEOUT_MIN_US;
+	if (t > MODBUSRTU_TIMEOUT_US)
+		return MODBUSRTU_TIMEOUT_US;
+	return t;
+}
+
+bool ModbusRTUTemplate::isOnline(uint8_t slaveId) {
+	TRTUSlaveStat* s = slaveStat(slaveId);
+	return !s || s->fails < MODBUSRTU_OFFLINE_COUNT;	// Slave is online until it fails to respond
+}
+
+void ModbusRTUTemplate::responseReceived(uint8_t slaveId, uint32_t elapsed, uint16_t len) {
+	TRTUSlaveStat* s = slaveStat(slaveId, true);
+	if (!s) return;
+	// Turnaround time is time elapsed since request sent less response frame transmission time and inter-frame gap
+	uint32_t tx = len * _t1 + _t;
+	uint32_t r = elapsed > tx ? elapsed - tx : 1;
+	if (!s->srtt) {
+		s->srtt = r;
+		s->rttvar = r / 2;
+	} else {
+		uint32_t delta = s->srtt > r ? s->srtt - r : r - s->srtt;
+		s->rttvar = (3 * s->rttvar + delta) / 4;
+		s->srtt = (7 * s->srtt + r) / 8;
+	}
+	s->fails = 0;
+}
+
+void ModbusRTUTemplate::responseTimeout(uint8_t slaveId) {
+	TRTUSlaveStat* s = slaveStat(slaveId, true);
+	if (!s) return;
+	if (s->fails < 0xFF)
+		s->fails++;
+	if (s->fails == MODBUSRTU_OFFLINE_COUNT)
+		s->probe = micros();
+}
+#endif
+
+#if defined(MODBUSRTU_STATS)
+TRTULatency* ModbusRTUTemplate::latency(uint8_t fc) {
+#define MODBUSRTU_COMPARE_LATENCY [fc](TRTULatency& l){return l.fc == fc;}
+	#if defined(MODBUS_USE_STL)
+	std::vector<TRTULatency>::iterator it = std::find_if(_latency.begin(), _latency.end(), MODBUSRTU_COMPARE_LATENCY);
+	if (it != _latency.end()) return &*it;
+	return nullptr;
+	#else
+	return _latency.entry(_latency.find(MODBUSRTU_COMPARE_LATENCY));
+	#endif
+}
+
+void ModbusRTUTemplate::latencyAdd(uint8_t fc, uint32_t us) {
+	uint8_t bucket = 0;
+	while (bucket < MODBUSRTU_STATS_BUCKETS - 1 && (us >> (bucket + 1)))
+		bucket++;
+	uint8_t codes[] = {0, fc};	// Overall entry and function code entry
+	for (uint8_t i = 0; i < (fc ? 2 : 1); i++) {
+		uint8_t code = codes[i];
+		TRTULatency* l = latency(code);
+		if (!l) {
+			TRTULatency tmp;
+			tmp.fc = code;
+			_latency.push_back(tmp);
+			l = latency(code);
+			if (!l) continue;
+		}
+		l->count++;
+		l->sum += us;
+		if (us < l->min) l->min = us;
+		if (us > l->max) l->max = us;
+		l->hist[bucket]++;
+	}
+}
+
+uint32_t ModbusRTUTemplate::latencyPercentile(uint8_t pct, uint8_t fc) {
+	TRTULatency* l = latency(fc);
+	if (!l || !l->count)
+		return 0;
+	uint32_t need = ((uint64_t)l->count * pct + 99) / 100;
+	uint32_t seen = 0;
+	for (uint8_t i = 0; i < MODBUSRTU_STATS_BUCKETS - 1; i++) {
+		seen += l->hist[i];
+		if (seen >= need) {
+			uint32_t upper = (2UL << i) - 1;
+			return upper < l->max ? upper : l->max;
+		}
+	}
+	return l->max;
+}
+
+void ModbusRTUTemplate::resetLatency() {
+	#if defined(MODBUS_USE_STL)
+	_latency.clear();
+	#else
+	while (_latency.size())
+		_latency.remove(0);
+	#endif
+}
+#endif
+
+#if defined(MODBUSRTU_FRAME_STATS)
+void ModbusRTUTemplate::frameError() {
+	// Bad frame following another bad one closer than two inter-frame times is considered split by jitter
+	if (_badFrame && _fragmentGap < 2 * _t) {
+		_frameStats.split++;
+		_frameStats.splitGap = _fragmentGap;
+		uint32_t t_us = _fragmentGap + _fragmentGap / 4;
+		if (t_us > _autoT) t_us = _autoT;
+		if (t_us > _t) _t = t_us;
+		_badFrame = false;
+		return;
+	}
+	_badFrame = true;
+}
+#endif
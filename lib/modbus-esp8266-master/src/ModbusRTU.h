@@ -8,6 +8,58 @@
 #pragma once
 #include "ModbusAPI.h"
 
+#if defined(MODBUSRTU_QUEUE)
+struct TRTURequest {
+	uint8_t		slaveId;
+	uint8_t*	frame = nullptr;
+	uint8_t		len;
+	TAddress	startreg;
+	cbTransaction cb = nullptr;
+	uint8_t*	data = nullptr;
+	bool		waitResponse;
+	uint32_t	deadline;	// millis() request is expected to be sent till
+};
+#endif
+#if defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+struct TRTUSlaveStat {
+	uint8_t		slaveId;
+	uint32_t	srtt = 0;	// Smoothed slave turnaround time in uS
+	uint32_t	rttvar = 0;	// Turnaround time variation in uS
+	uint8_t		fails = 0;	// Count of timeouts in a row
+	uint32_t	probe = 0;	// micros() of last request sent to offline slave
+};
+#endif
+
+#if defined(MODBUSRTU_STATS)
+struct TRTUTimestamps {	// micros() of last processed request stages
+	uint32_t	rx = 0;			// Last byte of request received
+	uint32_t	dispatch = 0;	// Request passed CRC check and handed to processing
+	uint32_t	txStart = 0;	// Response transmission started
+	uint32_t	txEnd = 0;		// Response transmission finished (flushed)
+};
+struct TRTULatency {
+	uint8_t		fc;				// Function code of request, 0 for all requests
+	uint32_t	count = 0;
+	uint32_t	min = 0xFFFFFFFF;
+	uint32_t	max = 0;
+	uint64_t	sum = 0;
+	uint32_t	hist[MODBUSRTU_STATS_BUCKETS] = {0};
+};
+#endif
+
+#if defined(MODBUSRTU_FRAME_STATS)
+struct TRTUFrameStats {
+	uint32_t	frames = 0;		// Frames received, including ones addressed to other slaves
+	uint32_t	crc = 0;		// CRC check failed
+	uint32_t	t15 = 0;		// Inter-character gap over 1.5 char inside of frame
+	uint32_t	overrun = 0;	// Frame longer than MODBUS_MAX_FRAME
+	uint32_t	truncated = 0;	// Frame shorter than 4 bytes
+	uint32_t	split = 0;		// Frames split in two by inter-character gap exceeded inter-frame time
+	uint32_t	maxGap = 0;		// Longest inter-character gap seen inside of frame in uS
+	uint32_t	splitGap = 0;	// Gap between fragments of last split frame in uS
+};
+#endif
+
 class ModbusRTUTemplate : public Modbus {
     protected:
         Stream* _port;
@@ -17,13 +69,14 @@ class ModbusRTUTemplate : public Modbus {
 #endif
 		bool _direct = true;	// Transmit control logic (true=txEnableDirect, false=inverse)
 		uint32_t _t;	// inter-frame delay in uS
-#if defined(MODBUSRTU_FLUSH_DELAY)
+#if defined(MODBUSRTU_FLUSH_DELAY) || defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
 		uint32_t _t1;	// char send time
 #endif
 		uint32_t t = 0;		// time sience last data byte arrived
 		bool isMaster = false;
 		uint8_t  _slaveId;
 		uint32_t _timestamp = 0;
+		uint32_t _timeout = MODBUSRTU_TIMEOUT_US;	// Response timeout for current transaction in uS
 		cbTransaction _cb = nullptr;
 		uint8_t* _data = nullptr;
 		uint8_t* _sentFrame = nullptr;
@@ -38,13 +91,64 @@ class ModbusRTUTemplate : public Modbus {
 		// cb - transaction callback function
 		// data - if not null use buffer to save returned data instead of local registers
 		bool rawSend(uint8_t slaveId, uint8_t* frame, uint8_t len);
+		void rxPoll();	// Update received frame length and last byte arrival time
+		bool startRequest(uint8_t slaveId, uint8_t* frame, uint8_t len, TAddress startreg, cbTransaction cb, uint8_t* data, bool waitResponse);
+		// Send frame and start transaction. Takes ownership of frame. Returns false if request is rejected (offline slave)
 		bool cleanup(); 	// Free clients if not connected and remove timedout transactions and transaction with forced events
+#if defined(MODBUSRTU_QUEUE)
+	public:
+		enum ScheduleMode {
+			SCHEDULE_FIFO,			// Queued requests are sent in order of submission
+			SCHEDULE_ROUND_ROBIN,	// Take turns between slaves, FIFO for requests to same slave
+			SCHEDULE_DEADLINE		// Earliest deadline first. See deadline()
+		};
+	protected:
+		#if defined(MODBUS_USE_STL)
+		std::vector<TRTURequest> _queue;
+		#else
+		DArray<TRTURequest, 2, 2> _queue;
+		#endif
+		ScheduleMode _schedule = SCHEDULE_FIFO;
+		uint32_t _deadline = 0;
+		uint8_t _lastSlave = 0;
+		size_t nextRequest();	// Returns queue position of request to be sent next
+		void dispatch();		// Send queued requests while bus is free
+#endif
+#if defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+		#if defined(MODBUS_USE_STL)
+		std::vector<TRTUSlaveStat> _stats;
+		#else
+		DArray<TRTUSlaveStat, 1, 1> _stats;
+		#endif
+		TRTUSlaveStat* slaveStat(uint8_t slaveId, bool create = false);
+		uint32_t responseTime(uint8_t* frame);	// Expected response frame transmission time for request in uS
+		void responseReceived(uint8_t slaveId, uint32_t elapsed, uint16_t len);
+		void responseTimeout(uint8_t slaveId);
+#endif
+#if defined(MODBUSRTU_STATS)
+		TRTUTimestamps _stamps;
+		#if defined(MODBUS_USE_STL)
+		std::vector<TRTULatency> _latency;
+		#else
+		DArray<TRTULatency, 1, 1> _latency;
+		#endif
+		void latencyAdd(uint8_t fc, uint32_t us);
+#endif
+#if defined(MODBUSRTU_FRAME_STATS)
+		TRTUFrameStats _frameStats;
+		uint32_t _gap = 0;			// Longest inter-character gap of frame being received
+		uint32_t _fragmentGap = 0;	// Gap between previous frame and frame being received
+		bool _badFrame = false;		// Previous frame failed CRC check or was truncated
+		uint32_t _autoT = 0;		// Inter-frame time auto-tune limit in uS, 0 - disabled
+		void frameError();
+#endif
 		uint16_t crc16(uint8_t address, uint8_t* frame, uint8_t pdulen);
 		uint16_t crc16_alt(uint8_t address, uint8_t* frame, uint8_t pduLen);
     public:
 		void setBaudrate(uint32_t baud = -1);
 		uint32_t calculateMinimumInterFrameTime(uint32_t baud, uint8_t char_bits = 11);
 		void setInterFrameTime(uint32_t t_us);
+		uint32_t interFrameTime() { return _t; }
 		uint32_t charSendTime(uint32_t baud, uint8_t char_bits = 11);
 		template <class T>
 		bool begin(T* port, int16_t txEnablePin = -1, bool txEnableDirect = true);
@@ -61,18 +165,40 @@ class ModbusRTUTemplate : public Modbus {
 		uint8_t server() { return _slaveId; }
 		inline uint8_t slave() { return server(); }
 		uint32_t eventSource() override {return address;}
+#if defined(MODBUSRTU_QUEUE)
+		~ModbusRTUTemplate() { dropQueue(); }
+		void schedule(ScheduleMode mode) { _schedule = mode; }
+		void deadline(uint32_t ms) { _deadline = ms; }	// Deadline for requests submitted next relative to submission time
+		size_t queued() { return _queue.size(); }
+		void dropQueue();	// Cancel all queued requests. Callbacks are called with EX_CANCEL
+#endif
+#if defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
+		uint32_t timeout(uint8_t slaveId, uint8_t* frame = nullptr);	// Response timeout for request to slave in uS
+		bool isOnline(uint8_t slaveId);
+#endif
+#if defined(MODBUSRTU_STATS)
+		const TRTUTimestamps& timestamps() { return _stamps; }
+		TRTULatency* latency(uint8_t fc = 0);	// Turnaround statistics for function code (0 - all requests). nullptr if no data
+		uint32_t latencyPercentile(uint8_t pct, uint8_t fc = 0);	// Upper bound of histogram bucket containing percentile in uS
+		void resetLatency();
+#endif
+#if defined(MODBUSRTU_FRAME_STATS)
+		const TRTUFrameStats& frameStats() { return _frameStats; }
+		void resetFrameStats() { _frameStats = TRTUFrameStats(); }
+		void autoInterFrameTime(uint32_t max_us) { _autoT = max_us; }	// Raise inter-frame time on split frames up to max_us. 0 - disable
+#endif
 };
 
 template <class T>
 bool ModbusRTUTemplate::begin(T* port, int16_t txEnablePin, bool txEnableDirect) {
     uint32_t baud = 0;
-    #if defined(ESP32) || defined(ESP8266) // baudRate() only available with ESP32+ESP8266
+    #if defined(ESP32) || defined(ESP8266) || defined(ARDUINO_ARCH_HOST) // baudRate() only available with ESP32+ESP8266 and host shim
     baud = port->baudRate();
     #else
     baud = 9600;
     #endif
 	setInterFrameTime(calculateMinimumInterFrameTime(baud));
-#if defined(MODBUSRTU_FLUSH_DELAY)
+#if defined(MODBUSRTU_FLUSH_DELAY) || defined(MODBUSRTU_ADAPTIVE_TIMEOUT)
 	_t1 = charSendTime(baud);
 #endif
     _port = port;
@@ -0,0 +1,10 @@
+/*
+    Modbus Library for Arduino
+    Modbus RTU over TCP for ESP8266/ESP32
+*/
+
+#pragma once
+#include "ModbusTCP.h"
+#include "ModbusRTUTCPTemplate.h"
+
+class ModbusRTUTCP : public ModbusAPI<ModbusRTUTCPTemplate<WiFiServerESPWrapper, WiFiClient>> {};
@@ -0,0 +1,249 @@
+/*
+    Modbus Library for Arduino
+    Modbus RTU over TCP general implementation
+    RTU frames (slave id + PDU + CRC, no MBAP) tunneled over TCP stream
+*/
+#pragma once
+#include "ModbusRTU.h"
+#include "ModbusTCPTemplate.h"
+
+template <class SERVER, class CLIENT>
+class ModbusRTUTCPTemplate : public ModbusRTUTemplate {
+	protected:
+	cbModbusConnect cbConnect = nullptr;
+	cbModbusConnect cbDisconnect = nullptr;
+	SERVER* tcpserver = nullptr;
+	CLIENT* tcpclient[MODBUSIP_MAX_CLIENTS];
+	uint8_t* rxbuf[MODBUSIP_MAX_CLIENTS];	// Frame reassembly buffer per connection
+	uint16_t rxlen[MODBUSIP_MAX_CLIENTS];
+	uint32_t rxtime[MODBUSIP_MAX_CLIENTS];	// micros() of last data arrival
+	int16_t n = -1;
+	void cleanupConnections();	// Free clients if not connected
+	int16_t frameLength(uint8_t* frame, uint16_t len);	// Expected request frame length. 0 - more data required to tell, -1 - unknown function
+	bool processFrame(uint8_t* frame, uint16_t len);	// Returns false on CRC error
+	uint16_t send(uint8_t slaveId, TAddress startreg, cbTransaction cb, uint8_t unit = MODBUSIP_UNIT, uint8_t* data = nullptr, bool waitResponse = true);
+	// Client mode is not supported. Requests are dropped.
+	public:
+	ModbusRTUTCPTemplate();
+	~ModbusRTUTCPTemplate();
+	bool begin(uint16_t port = MODBUSTCP_PORT);	// Start listening for RTU over TCP connections. Use slave() to set slave id.
+	void task();
+	void onConnect(cbModbusConnect cb = nullptr) { cbConnect = cb; }
+	void onDisconnect(cbModbusConnect cb = nullptr) { cbDisconnect = cb; }
+	uint32_t eventSource() override;	// Returns IP of current processing client query
+};
+
+template <class SERVER, class CLIENT>
+ModbusRTUTCPTemplate<SERVER, CLIENT>::ModbusRTUTCPTemplate() {
+	for (uint16_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++) {
+		tcpclient[i] = nullptr;
+		rxbuf[i] = nullptr;
+		rxlen[i] = 0;
+	}
+	_port = nullptr;
+	_t = 1750UL;	// Frame gap for unknown function codes
+	_slaveId = 1;
+}
+
+template <class SERVER, class CLIENT>
+ModbusRTUTCPTemplate<SERVER, CLIENT>::~ModbusRTUTCPTemplate() {
+	free(_frame);
+	_frame = nullptr;
+	delete tcpserver;
+	tcpserver = nullptr;
+	for (uint16_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++) {
+		delete tcpclient[i];
+		tcpclient[i] = nullptr;
+		free(rxbuf[i]);
+		rxbuf[i] = nullptr;
+	}
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusRTUTCPTemplate<SERVER, CLIENT>::begin(uint16_t port) {
+	if (tcpserver)
+		return true;
+	tcpserver = new SERVER(port);
+	if (!tcpserver)
+		return false;
+	tcpserver->begin();
+	return true;
+}
+
+template <class SERVER, class CLIENT>
+uint32_t ModbusRTUTCPTemplate<SERVER, CLIENT>::eventSource() {
+	if (n >= 0 && n < MODBUSIP_MAX_CLIENTS && tcpclient[n])
+	#if !defined(ethernet_h)
+		return (uint32_t)tcpclient[n]->remoteIP();
+	#else
+		return 1;
+	#endif
+	return (uint32_t)INADDR_NONE;
+}
+
+template <class SERVER, class CLIENT>
+uint16_t ModbusRTUTCPTemplate<SERVER, CLIENT>::send(uint8_t slaveId, TAddress startreg, cbTransaction cb, uint8_t unit, uint8_t* data, bool waitResponse) {
+	free(_frame);
+	_frame = nullptr;
+	_len = 0;
+	return 0;
+}
+
+template <class SERVER, class CLIENT>
+int16_t ModbusRTUTCPTemplate<SERVER, CLIENT>::frameLength(uint8_t* frame, uint16_t len) {
+	// Frame length = slave id + PDU + CRC
+	if (len < 2)
+		return 0;
+	switch (frame[1]) {
+	case FC_READ_COILS:
+	case FC_READ_INPUT_STAT:
+	case FC_READ_REGS:
+	case FC_READ_INPUT_REGS:
+	case FC_WRITE_COIL:
+	case FC_WRITE_REG:
+	case FC_DIAGNOSTICS:
+		return 8;
+	case FC_WRITE_COILS:
+	case FC_WRITE_REGS:
+		return len < 7 ? 0 : 9 + frame[6];
+	case FC_READ_FILE_REC:
+	case FC_WRITE_FILE_REC:
+		return len < 3 ? 0 : 5 + frame[2];
+	case FC_MASKWRITE_REG:
+		return 10;
+	case FC_READWRITE_REGS:
+		return len < 11 ? 0 : 13 + frame[10];
+	default:
+		return -1;
+	}
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusRTUTCPTemplate<SERVER, CLIENT>::processFrame(uint8_t* frame, uint16_t len) {
+	uint16_t frameCrc = ((frame[len - 2] << 8) | frame[len - 1]); // Last two byts = crc
+	if (frameCrc != crc16(frame[0], frame + 1, len - 3))
+		return false;
+	address = frame[0];
+	bool valid_frame = (address == MODBUSRTU_BROADCAST || address == _slaveId);
+	if (!valid_frame && !_cbRaw)
+		return true;
+	free(_frame);
+	_len = len - 3;
+	_frame = (uint8_t*) malloc(_len);
+	if (!_frame) {
+		_len = 0;
+		return true;
+	}
+	memcpy(_frame, frame + 1, _len);
+	_reply = EX_PASSTHROUGH;
+	if (_cbRaw) {
+		frame_arg_t header_data = { address, true };
+		_reply = _cbRaw(_frame, _len, (void*)&header_data);
+	}
+	if ((valid_frame || _reply == EX_FORCE_PROCESS) && (_reply == EX_PASSTHROUGH || _reply == EX_FORCE_PROCESS)) {
+		slavePDU(_frame);
+		if (address == MODBUSRTU_BROADCAST)
+			_reply = Modbus::REPLY_OFF;    // No reply for Broadcasts
+		if (_reply != Modbus::REPLY_OFF && _len + 3 <= MODBUS_MAX_FRAME) {
+			// Whole response is written at once to be sent in single TCP segment
+			uint8_t sbuf[MODBUS_MAX_FRAME];
+			uint16_t newCrc = crc16(address, _frame, _len);
+			sbuf[0] = address;
+			memcpy(sbuf + 1, _frame, _len);
+			sbuf[_len + 1] = newCrc >> 8;
+			sbuf[_len + 2] = newCrc & 0xFF;
+			tcpclient[n]->write(sbuf, _len + 3);
+		}
+	}
+	free(_frame);
+	_frame = nullptr;
+	_len = 0;
+	return true;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusRTUTCPTemplate<SERVER, CLIENT>::task() {
+	uint32_t taskStart = millis();
+	cleanupConnections();
+	if (tcpserver) {
+		CLIENT c;
+		uint16_t budget = MODBUSIP_MAX_ACCEPT;
+#if defined(MODBUSIP_USE_AVAILABLE)
+		while (budget-- && millis() - taskStart < MODBUSIP_MAX_READMS && (c = tcpserver->available())) {
+#else
+		while (budget-- && millis() - taskStart < MODBUSIP_MAX_READMS && (c = tcpserver->accept())) {
+#endif
+			CLIENT* currentClient = new CLIENT(c);
+			if (!currentClient || !currentClient->connected()) {
+				delete currentClient;
+				continue;
+			}
+			if (cbConnect == nullptr || cbConnect(currentClient->remoteIP())) {
+				for (n = 0; n < MODBUSIP_MAX_CLIENTS && tcpclient[n]; n++);
+				if (n < MODBUSIP_MAX_CLIENTS) {
+					rxbuf[n] = (uint8_t*) malloc(MODBUS_MAX_FRAME);
+					if (rxbuf[n]) {
+						tcpclient[n] = currentClient;
+						rxlen[n] = 0;
+#if defined(MODBUSIP_USE_AVAILABLE)
+						break;	// while
+#else
+						continue; // while
+#endif
+					}
+				}
+			}
+			// Close connection if callback returns false or MODBUSIP_MAX_CLIENTS reached
+			delete currentClient;
+		}
+	}
+	for (n = 0; n < MODBUSIP_MAX_CLIENTS; n++) {
+		if (!tcpclient[n]) continue;
+		if (!tcpclient[n]->connected()) continue;
+		int avail = tcpclient[n]->available();
+		if (avail > 0 && rxlen[n] < MODBUS_MAX_FRAME) {
+			int room = MODBUS_MAX_FRAME - rxlen[n];
+			int r = tcpclient[n]->read(rxbuf[n] + rxlen[n], avail < room ? avail : room);
+			if (r > 0) {
+				rxlen[n] += r;
+				rxtime[n] = micros();
+			}
+		}
+		// Frames are delimited by length known from function code, gap is used for unknown functions only
+		while (rxlen[n] >= 4) {
+			int16_t flen = frameLength(rxbuf[n], rxlen[n]);
+			if (flen < 0) {	// Unknown function. Frame ends on inter-frame gap as for serial line
+				if (micros() - rxtime[n] < _t)
+					break;
+				flen = rxlen[n];
+			}
+			if (flen == 0 || (flen <= MODBUS_MAX_FRAME && flen > rxlen[n]))
+				break;	// Wait for rest of frame
+			if (flen < 4 || flen > MODBUS_MAX_FRAME || !processFrame(rxbuf[n], flen)) {
+				rxlen[n] = 0;	// Resync on invalid frame by dropping all buffered data
+				break;
+			}
+			rxlen[n] -= flen;
+			memmove(rxbuf[n], rxbuf[n] + flen, rxlen[n]);
+		}
+		if (rxlen[n] && (rxlen[n] >= MODBUS_MAX_FRAME || micros() - rxtime[n] > MODBUSIP_TIMEOUT * 1000UL))
+			rxlen[n] = 0;	// Drop frame never completed
+	}
+	n = -1;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusRTUTCPTemplate<SERVER, CLIENT>::cleanupConnections() {
+	for (uint16_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++) {
+		if (tcpclient[i] && !tcpclient[i]->connected()) {
+			tcpclient[i]->stop();
+			delete tcpclient[i];
+			tcpclient[i] = nullptr;
+			free(rxbuf[i]);
+			rxbuf[i] = nullptr;
+			rxlen[i] = 0;
+			if (cbDisconnect && cbEnabled)
+				cbDisconnect(IPADDR_NONE);
+		}
+	}
+}
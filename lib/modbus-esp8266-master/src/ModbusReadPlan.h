@@ -0,0 +1,277 @@
+/*
+    Modbus Library for Arduino
+	Read request planner. Merges scattered tags into minimal count of read requests
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+#pragma once
+#include "ModbusAPI.h"
+#if defined(MODBUS_USE_STL)
+#include <vector>
+#include <algorithm>
+
+// TYPEID is slave id (uint8_t) for ModbusRTU or IPAddress for ModbusTCP/ModbusTLS
+template <typename TYPEID>
+class ModbusReadPlan {
+	public:
+	ModbusReadPlan(uint16_t gap = MODBUSAPI_PLAN_GAP) : _gap(gap) {}
+	// Add tag. value is updated on each scan(). Returns tag index or -1 if register type doesn't match value type
+	int16_t add(TYPEID id, TAddress reg, uint16_t* value, uint8_t unit = MODBUSIP_UNIT) {
+		if (reg.type != TAddress::HREG && reg.type != TAddress::IREG)
+			return -1;
+		return addTag(id, reg, value, unit);
+	}
+	int16_t add(TYPEID id, TAddress reg, bool* value, uint8_t unit = MODBUSIP_UNIT) {
+		if (reg.type != TAddress::COIL && reg.type != TAddress::ISTS)
+			return -1;
+		return addTag(id, reg, value, unit);
+	}
+	// Registers never to be read as part of merged request (e.g. reading them returns EX_ILLEGAL_ADDRESS)
+	void exclude(TYPEID id, TAddress reg, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		if (!numregs)
+			return;
+		_excluded.push_back({id, key(id), unit, reg.type, reg.address, (uint16_t)(reg.address + numregs - 1)});
+		_dirty = true;
+	}
+	void gap(uint16_t regs) { _gap = regs; _dirty = true; }	// Max count of unused registers read to merge tags
+	// Max count of registers per request. Set lower than MODBUS_MAX_WORDS/MODBUS_MAX_BITS if response doesn't fit
+	// frame buffer of transport (e.g. ModbusTCP reads up to (MODBUSIP_MAXFRAME - 2) / 2 words)
+	void limit(uint16_t words, uint16_t bits = MODBUS_MAX_BITS) {
+		_maxWords = (words && words < MODBUS_MAX_WORDS) ? words : MODBUS_MAX_WORDS;
+		_maxBits = (bits && bits < MODBUS_MAX_BITS) ? bits : MODBUS_MAX_BITS;
+		_dirty = true;
+	}
+	// Remove all tags and excluded ranges. Returns false if scan is in progress
+	bool clear() {
+		if (!ready())
+			return false;
+		_tags.clear(); _order.clear(); _excluded.clear(); _requests.clear(); _next = 0; _dirty = false;
+		return true;
+	}
+	uint16_t tags() { return _tags.size(); }
+	uint16_t requests() { if (_dirty && ready()) build(); return _requests.size(); }	// Requests per scan
+	// Start scan cycle: send planned requests, keeping up to window of them in progress. Next request is sent
+	// from task() as previous completes. Use window 1 for ModbusRTU without MODBUSRTU_QUEUE.
+	// Plan and master must stay in place till scan is completed. Returns false if previous scan is in progress.
+	template <class MASTER>
+	bool scan(MASTER& mb, uint16_t window = 1);
+	bool ready() { return !_pending && _next >= _requests.size(); }	// Scan is completed
+	// Start scan cycle without sending requests. Requests are sent one by one by step(), e.g. to interleave
+	// several plans on the same transport. Returns false if previous scan is in progress.
+	bool start();
+	template <class MASTER>
+	bool step(MASTER& mb) { if (_next >= _requests.size()) return false; send(mb); return true; }
+	uint16_t pending() { return _pending; }	// Requests in progress
+	uint16_t remaining() { return _next < _requests.size() ? _requests.size() - _next : 0; }	// Requests not sent yet
+	// Result of request reading the tag in last scan. Tag value is updated on EX_SUCCESS only
+	Modbus::ResultCode result(int16_t tag) {
+		if (tag < 0 || tag >= (int16_t)_tags.size() || _tags[tag].request < 0)
+			return Modbus::EX_GENERAL_FAILURE;
+		return _requests[_tags[tag].request].result;
+	}
+	private:
+	struct TTag {
+		TYPEID id;
+		uint32_t idKey;
+		uint8_t unit;
+		TAddress::RegType type;
+		uint16_t address;
+		void* value;
+		int16_t request;	// Planned request reading the tag
+	};
+	struct TRange {
+		TYPEID id;
+		uint32_t idKey;
+		uint8_t unit;
+		TAddress::RegType type;
+		uint16_t first;
+		uint16_t last;
+	};
+	struct TRequest {
+		TYPEID id;
+		uint8_t unit;
+		TAddress::RegType type;
+		uint16_t start;
+		uint16_t count;
+		uint16_t first;	// Tags [first, last) in _order
+		uint16_t last;
+		Modbus::ResultCode result;
+		std::vector<uint16_t> words;
+		std::unique_ptr<bool[]> bits;
+	};
+	std::vector<TTag> _tags;
+	std::vector<uint16_t> _order;	// Tag indexes sorted by slave, unit, type and address
+	std::vector<TRange> _excluded;
+	std::vector<TRequest> _requests;
+	uint16_t _gap;
+	uint16_t _maxWords = MODBUS_MAX_WORDS;
+	uint16_t _maxBits = MODBUS_MAX_BITS;
+	bool _dirty = false;
+	uint16_t _next = 0;	// Next request to send in current scan
+	uint16_t _pending = 0;
+	uint16_t _window = 0;	// Requests in progress sent automatically, 0 if sent by step()
+	static uint32_t key(TYPEID id) { return (uint32_t)id; }
+	int16_t addTag(TYPEID id, TAddress reg, void* value, uint8_t unit) {
+		if (!value || _tags.size() >= INT16_MAX || !ready())
+			return -1;
+		_tags.push_back({id, key(id), unit, reg.type, reg.address, value, -1});
+		_dirty = true;
+		return _tags.size() - 1;
+	}
+	bool sameGroup(const TTag& a, const TTag& b) {
+		return a.idKey == b.idKey && a.unit == b.unit && a.type == b.type;
+	}
+	bool excluded(const TTag& t, uint16_t first, uint16_t last) {	// Range of tag's group intersects excluded one
+		for (const TRange& r : _excluded)
+			if (r.idKey == t.idKey && r.unit == t.unit && r.type == t.type && r.first <= last && r.last >= first)
+				return true;
+		return false;
+	}
+	void build();
+	template <class MASTER>
+	void send(MASTER& mb);
+	void complete(uint16_t i, Modbus::ResultCode result);
+};
+
+template <typename TYPEID>
+void ModbusReadPlan<TYPEID>::build() {
+	_order.resize(_tags.size());
+	for (uint16_t i = 0; i < _order.size(); i++)
+		_order[i] = i;
+	std::sort(_order.begin(), _order.end(), [this](uint16_t a, uint16_t b) {
+		const TTag& x = _tags[a];
+		const TTag& y = _tags[b];
+		if (x.idKey != y.idKey) return x.idKey < y.idKey;
+		if (x.unit != y.unit) return x.unit < y.unit;
+		if (x.type != y.type) return x.type < y.type;
+		return x.address < y.address;
+	});
+	_requests.clear();
+	for (uint16_t i = 0; i < _order.size(); i++) {
+		TTag& t = _tags[_order[i]];
+		uint16_t maxCount = (t.type == TAddress::HREG || t.type == TAddress::IREG) ? _maxWords : _maxBits;
+		if (!_requests.empty()) {
+			TRequest& r = _requests.back();
+			TTag& prev = _tags[_order[i - 1]];
+			uint16_t end = r.start + r.count - 1;	// Last register read by request
+			if (sameGroup(prev, t)) {
+				if (t.address <= end) {	// Same register is read for several tags
+					r.last = i + 1;
+					t.request = _requests.size() - 1;
+					continue;
+				}
+				if (t.address - end - 1 <= _gap && t.address - r.start < maxCount && !excluded(t, end + 1, t.address - 1)) {
+					r.count = t.address - r.start + 1;
+					r.last = i + 1;
+					t.request = _requests.size() - 1;
+					continue;
+				}
+			}
+		}
+		_requests.emplace_back();
+		TRequest& r = _requests.back();
+		r.id = t.id;
+		r.unit = t.unit;
+		r.type = t.type;
+		r.start = t.address;
+		r.count = 1;
+		r.first = i;
+		r.last = i + 1;
+		r.result = Modbus::EX_GENERAL_FAILURE;
+		t.request = _requests.size() - 1;
+	}
+	for (TRequest& r : _requests) {
+		if (r.type == TAddress::HREG || r.type == TAddress::IREG)
+			r.words.resize(r.count);
+		else
+			r.bits.reset(new bool[r.count]);
+	}
+	_next = _requests.size();	// No scan in progress
+	_dirty = false;
+}
+
+template <typename TYPEID>
+template <class MASTER>
+bool ModbusReadPlan<TYPEID>::scan(MASTER& mb, uint16_t window) {
+	if (!start())
+		return false;
+	_window = window ? window : 1;
+	while (_next < _requests.size() && _pending < _window)
+		send(mb);
+	return true;
+}
+
+template <typename TYPEID>
+bool ModbusReadPlan<TYPEID>::start() {
+	if (!ready())
+		return false;
+	if (_dirty)
+		build();
+	_next = 0;
+	_window = 0;
+	return true;
+}
+
+template <typename TYPEID>
+template <class MASTER>
+void ModbusReadPlan<TYPEID>::send(MASTER& mb) {
+	uint16_t i = _next++;
+	TRequest& r = _requests[i];
+	_pending++;
+	ModbusFuture f = mb.async([&](cbTransaction cb) -> uint16_t {
+		switch (r.type) {
+		case TAddress::HREG:
+			return mb.readHreg(r.id, r.start, r.words.data(), r.count, cb, r.unit);
+		case TAddress::IREG:
+			return mb.readIreg(r.id, r.start, r.words.data(), r.count, cb, r.unit);
+		case TAddress::COIL:
+			return mb.readCoil(r.id, r.start, r.bits.get(), r.count, cb, r.unit);
+		default:
+			return mb.readIsts(r.id, r.start, r.bits.get(), r.count, cb, r.unit);
+		}
+	});
+	f.then([this, &mb, i](Modbus::ResultCode result) {	// Called from task() or at once if request is not sent
+		complete(i, result);
+		_pending--;
+		if (_next < _requests.size() && _pending < _window)
+			send(mb);
+	});
+}
+
+template <typename TYPEID>
+void ModbusReadPlan<TYPEID>::complete(uint16_t i, Modbus::ResultCode result) {
+	TRequest& r = _requests[i];
+	r.result = result;
+	if (result == Modbus::EX_SUCCESS) {
+		for (uint16_t j = r.first; j < r.last; j++) {
+			TTag& t = _tags[_order[j]];
+			if (r.bits)
+				*(bool*)t.value = r.bits[t.address - r.start];
+			else
+				*(uint16_t*)t.value = r.words[t.address - r.start];
+		}
+	} else if (result == Modbus::EX_ILLEGAL_ADDRESS) {
+		// Some of unused registers merged into request may be missing on slave. Split request at gap closest
+		// to its middle from next scan on. Repeated failures narrow missing range down in few scans.
+		uint16_t middle = r.start + r.count / 2;
+		uint16_t best = 0;
+		uint16_t distance = UINT16_MAX;
+		for (uint16_t j = r.first + 1; j < r.last; j++) {
+			TTag& prev = _tags[_order[j - 1]];
+			TTag& t = _tags[_order[j]];
+			if (t.address <= prev.address + 1)
+				continue;
+			uint16_t d = t.address > middle ? t.address - middle : middle - t.address;
+			if (d < distance) {
+				distance = d;
+				best = j;
+			}
+		}
+		if (best) {
+			TTag& prev = _tags[_order[best - 1]];
+			TTag& t = _tags[_order[best]];
+			_excluded.push_back({t.id, t.idKey, t.unit, t.type, (uint16_t)(prev.address + 1), (uint16_t)(t.address - 1)});
+			_dirty = true;
+		}
+	}
+}
+#endif
@@ -0,0 +1,167 @@
+/*
+    Modbus Library for Arduino
+	Thread-safe client request queue served by single bus owner task
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+#pragma once
+#include "ModbusAPI.h"
+#if defined(MODBUSAPI_THREADS)
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+
+// Requests are submitted from any task or thread and sent by the bus owner task calling task() in loop. Lock is held
+// only to queue and dequeue requests, so the bus is kept busy by owner task while others wait for results without spinning.
+// Modbus object itself must be accessed by the owner task only.
+template <class MASTER>
+class ModbusRequestQueue {
+	public:
+	// Sends request from the owner task with given transaction callback, returns transaction id
+	typedef std::function<uint16_t(MASTER& mb, cbTransaction cb)> Request;
+	typedef std::function<void(Modbus::ResultCode)> cbResult;
+	// window is count of requests in progress at once. Keep 1 for ModbusRTU without MODBUSRTU_QUEUE
+	ModbusRequestQueue(MASTER& mb, uint16_t window = 1, size_t capacity = MODBUSAPI_THREAD_QUEUE) :
+		_mb(mb), _window(window ? window : 1), _capacity(capacity ? capacity : 1) {}
+	// Queued requests are cancelled. Transactions in progress call back into the queue, so the Modbus object is
+	// processed till they complete or time out. Destroy from the owner task or after it has stopped calling task()
+	~ModbusRequestQueue() {
+		cancel();
+		while (pending())
+			_mb.task();
+	}
+	// Any task. Queue request, done is called from owner task on completion. Returns false if queue is full.
+	// done is called during frame processing, it may submit() next request but must not access Modbus object
+	bool submit(Request request, cbResult done = nullptr);
+	// Any task but the owner one. Queue request and block till it's completed. Waits for free space if queue is full
+	Modbus::ResultCode call(Request request);
+	template <typename TYPEID>
+	Modbus::ResultCode read(TYPEID id, TAddress reg, uint16_t* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return call([&](MASTER& mb, cbTransaction cb) { return mb.read(id, reg, value, numregs, cb, unit); });
+	}
+	template <typename TYPEID>
+	Modbus::ResultCode read(TYPEID id, TAddress reg, bool* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return call([&](MASTER& mb, cbTransaction cb) { return mb.read(id, reg, value, numregs, cb, unit); });
+	}
+	template <typename TYPEID>
+	Modbus::ResultCode write(TYPEID id, TAddress reg, uint16_t value, uint8_t unit = MODBUSIP_UNIT) {
+		return call([&](MASTER& mb, cbTransaction cb) { return mb.write(id, reg, value, cb, unit); });
+	}
+	template <typename TYPEID>
+	Modbus::ResultCode write(TYPEID id, TAddress reg, bool value, uint8_t unit = MODBUSIP_UNIT) {
+		return call([&](MASTER& mb, cbTransaction cb) { return mb.write(id, reg, value, cb, unit); });
+	}
+	template <typename TYPEID>
+	Modbus::ResultCode write(TYPEID id, TAddress reg, uint16_t* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return call([&](MASTER& mb, cbTransaction cb) { return mb.write(id, reg, value, numregs, cb, unit); });
+	}
+	template <typename TYPEID>
+	Modbus::ResultCode write(TYPEID id, TAddress reg, bool* value, uint16_t numregs = 1, uint8_t unit = MODBUSIP_UNIT) {
+		return call([&](MASTER& mb, cbTransaction cb) { return mb.write(id, reg, value, numregs, cb, unit); });
+	}
+	// Owner task. Send queued requests and process the bus. If there is nothing to do waits up to idleMs for submission
+	void task(uint32_t idleMs = 0);
+	void cancel();	// Drop queued requests, they are completed with EX_CANCEL
+	size_t queued() { std::lock_guard<std::mutex> lock(_mutex); return _queue.size(); }
+	uint16_t pending() { std::lock_guard<std::mutex> lock(_mutex); return _pending; }	// Requests in progress
+	private:
+	struct TJob {
+		Request request;
+		cbResult done;
+		Modbus::ResultCode result = Modbus::EX_GENERAL_FAILURE;
+		bool completed = false;
+	};
+	MASTER& _mb;
+	uint16_t _window;
+	size_t _capacity;
+	std::mutex _mutex;
+	std::condition_variable _submitted;	// Signals owner task waiting for requests
+	std::condition_variable _changed;	// Signals submitters waiting for completion or free space
+	std::deque<std::shared_ptr<TJob>> _queue;
+	uint16_t _pending = 0;
+	std::thread::id _owner;
+	bool _hasOwner = false;
+	void complete(std::shared_ptr<TJob> job, Modbus::ResultCode result, bool sent);
+};
+
+template <class MASTER>
+bool ModbusRequestQueue<MASTER>::submit(Request request, cbResult done) {
+	auto job = std::make_shared<TJob>();
+	job->request = request;
+	job->done = done;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_queue.size() >= _capacity)
+			return false;
+		_queue.push_back(job);
+	}
+	_submitted.notify_one();
+	return true;
+}
+
+template <class MASTER>
+Modbus::ResultCode ModbusRequestQueue<MASTER>::call(Request request) {
+	auto job = std::make_shared<TJob>();
+	job->request = request;
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (_hasOwner && _owner == std::this_thread::get_id())	// Would wait for itself forever
+		return Modbus::EX_GENERAL_FAILURE;
+	_changed.wait(lock, [this] { return _queue.size() < _capacity; });
+	_queue.push_back(job);
+	_submitted.notify_one();
+	_changed.wait(lock, [&job] { return job->completed; });
+	return job->result;
+}
+
+template <class MASTER>
+void ModbusRequestQueue<MASTER>::task(uint32_t idleMs) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_owner = std::this_thread::get_id();
+	_hasOwner = true;
+	if (idleMs && _queue.empty() && !_pending)
+		_submitted.wait_for(lock, std::chrono::milliseconds(idleMs), [this] { return !_queue.empty(); });
+	while (_pending < _window && !_queue.empty()) {
+		std::shared_ptr<TJob> job = _queue.front();
+		_queue.pop_front();
+		_pending++;
+		lock.unlock();
+		_changed.notify_all();	// Free space in queue
+		uint16_t id = job->request(_mb, [this, job](Modbus::ResultCode event, uint16_t, void*) {
+			complete(job, event, true);
+			return true;
+		});
+		if (!id)
+			complete(job, Modbus::EX_GENERAL_FAILURE, true);	// Not sent. No-op if callback is already called
+		lock.lock();
+	}
+	lock.unlock();
+	_mb.task();
+}
+
+template <class MASTER>
+void ModbusRequestQueue<MASTER>::cancel() {
+	std::deque<std::shared_ptr<TJob>> queue;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		queue.swap(_queue);
+	}
+	for (auto& job : queue)
+		complete(job, Modbus::EX_CANCEL, false);
+}
+
+template <class MASTER>
+void ModbusRequestQueue<MASTER>::complete(std::shared_ptr<TJob> job, Modbus::ResultCode result, bool sent) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (job->completed)
+			return;
+		job->result = result;
+		job->completed = true;
+		if (sent)
+			_pending--;
+	}
+	_changed.notify_all();
+	if (job->done)
+		job->done(result);
+}
+#endif
@@ -33,11 +33,16 @@ Also note STL issue workaround code in Modbus.cpp
 //#define ARDUINO_SAM_DUE_STL
 #endif
 
+/*
+#define ARDUINO_ARCH_HOST
+Native (Linux) build against ArduinoHost shim. Set by build environment.
+*/
+
 /*
 #define MODBUS_USE_STL
 If defined C STL will be used.
 */
-#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_STM32) || defined(ARDUINO_SAM_DUE_STL)
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_STM32) || defined(ARDUINO_SAM_DUE_STL) || defined(ARDUINO_ARCH_HOST)
 #define MODBUS_USE_STL
 #endif
 
@@ -59,6 +64,8 @@ If defined regisers count will be limited.
 #define MODBUS_MAX_BITS 0x07D0
 #define MODBUS_FILES
 #define MODBUS_MAX_FILES 0x270F
+#define MODBUS_MAX_FILE_READ 0x0079
+#define MODBUS_MAX_FILE_WRITE 0x007A
 #define MODBUSTCP_PORT 	  502
 #define MODBUSTLS_PORT 	  802
 #define MODBUSIP_MINFRAME 2
@@ -75,14 +82,112 @@ ESP32 only. Outgoing connection attempt timeout
 //#define MODBUSIP_CONNECT_TIMEOUT 1000
 
 #define MODBUSIP_UNIT	  255
+/*
+#define MODBUSIP_MAX_TRANSACTIONS 16
+Maximum number of outgoing requests waiting for response. Transactions are kept in fixed size table indexed by
+transaction id, so response lookup and timeout check cost doesn't depend on number of requests in flight.
+*/
+#if defined(ARDUINO_ARCH_HOST)
+#define MODBUSIP_MAX_TRANSACTIONS 256
+#else
 #define MODBUSIP_MAX_TRANSACTIONS 16
+#endif
+/*
+#define MODBUSIP_MAX_CLIENTS 8
+Maximum number of simultaneous connections (up to 32767). Connection table is allocated on demand and doubled
+when full, so memory is used for connections actually opened only.
+#define MODBUSIP_POLL
+Use poll() to visit only connections having incoming data instead of querying each one on every task() call.
+CLIENT class is required to provide fd() to be polled (WiFiClient on ESP32, host sockets). Connections without it
+are visited on each call as usual. Do not use with ModbusTLS as decrypted data may be pending without socket events
+(host TLS shim is fine as it reads records from socket one by one).
+#define MODBUSIP_EPOLL
+Linux only. Same as MODBUSIP_POLL but sockets are registered to epoll once, so task() cost depends on number of
+connections having data rather than on total number of connections. Server socket is watched as well, and
+eventFd() allows application to sleep until there are events instead of calling task() in a busy loop.
+*/
 #if defined(ESP32)
 #define MODBUSIP_MAX_CLIENTS    8
+//#define MODBUSIP_POLL
+#elif defined(ARDUINO_ARCH_HOST)
+#define MODBUSIP_MAX_CLIENTS    1024
+#define MODBUSIP_EPOLL
 #else
 #define MODBUSIP_MAX_CLIENTS    4
 #endif
+/*
+#define MODBUSIP_UNIQUE_CLIENTS
+New incoming connection closes previous one from the same IP.
+Not used on host as all local clients and load generators share the same IP.
+*/
+#if !defined(ARDUINO_ARCH_HOST)
 #define MODBUSIP_UNIQUE_CLIENTS
+#endif
 #define MODBUSIP_MAX_READMS 100
+/*
+#define MODBUSIP_MAX_ACCEPT 4
+Maximum number of connections accepted per task() call. Rest are left pending in listen backlog, so reconnect
+storm does not take time of established connections.
+*/
+#if defined(ARDUINO_ARCH_HOST)
+#define MODBUSIP_MAX_ACCEPT 64
+#else
+#define MODBUSIP_MAX_ACCEPT 4
+#endif
+/*
+#define MODBUSIP_PASS_REQUESTS 4
+Maximum number of requests served from one connection per task() pass, multiplied by connection weight (see onWeight()).
+Rest of pipelined requests are left buffered till next pass, so other connections are served in between.
+*/
+#if defined(ARDUINO_ARCH_HOST)
+#define MODBUSIP_PASS_REQUESTS 16
+#else
+#define MODBUSIP_PASS_REQUESTS 4
+#endif
+/*
+#define MODBUSIP_EVICT_IDLE 1000
+If connection table is full new incoming connection replaces least recently active one (by time of last request)
+provided it's idle for at least specified mS. 0 - new connection is closed. See also idleTimeout().
+*/
+#define MODBUSIP_EVICT_IDLE 1000
+
+/*
+ModbusTLS on ESP8266 and host (BearSSL API)
+#define MODBUSTLS_CREDENTIALS 4
+Number of certificates, private and public keys parsed once and shared by all connections. Cached by pointer
+to PEM text, so pass the same strings on each connect(). If cache is full, entry not used by server or open
+connection is replaced. connect() fails if all are in use.
+#define MODBUSTLS_SESSIONS 4
+Number of sessions to remote servers kept by client for abbreviated handshake on reconnect. 0 - full handshake.
+Session is resumed only by connect() with the same CA certificate or known key as it was established with.
+#define MODBUSTLS_SERVER_SESSIONS 8
+Number of client sessions cached by server. 0 - full handshake.
+*/
+#define MODBUSTLS_CREDENTIALS 4
+#define MODBUSTLS_SESSIONS 4
+#define MODBUSTLS_SERVER_SESSIONS 8
+
+/*
+#define MODBUSIP_TX_BUFFER 512
+Size of per connection transmit buffer. Responses to all requests received from connection in single task() pass
+are collected in the buffer and sent with one write(). Must fit at least one response (7 + MODBUS_MAX_FRAME).
+Part of data socket doesn't accept at once is kept and sent once it's writable. Connection which responses
+don't fit the buffer (client doesn't read them) is dropped.
+#define MODBUSIP_NODELAY
+Disable Nagle algorithm on connections if client class provides setNoDelay(). As responses are already coalesced
+delaying of small segments only adds latency.
+*/
+#define MODBUSIP_TX_BUFFER 512
+#define MODBUSIP_NODELAY
+
+/*
+#define MODBUSIP_UNIT_BANKS
+Allow separate register sets per unit id on ModbusTCP server. See addUnit(). Requests are dispatched to bank
+by MBAP unit id with table lookup. onSet()/onGet() callbacks are bound to address and shared by all banks.
+*/
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_HOST)
+#define MODBUSIP_UNIT_BANKS
+#endif
 
 /*
 Use available() instead of accept() to get TCP client
@@ -106,6 +211,41 @@ Otherwise IP addresses only must be used
 #define MB_SERIAL_BUFFER 128
 #define MODBUSRTU_TIMEOUT 1000
 #define MODBUSRTU_MAX_READMS 100
+
+/*
+#define MODBUSRTU_QUEUE 16
+Master requests sent while previous transaction is in progress are queued (up to specified count) instead of being rejected.
+Queued requests are sent from task() in FIFO, round-robin by slave id or earliest deadline order. See schedule().
+*/
+//#define MODBUSRTU_QUEUE 16
+
+/*
+#define MODBUSRTU_ADAPTIVE_TIMEOUT
+Use per-slave response timeout calculated from measured slave turnaround time (srtt + 4 * rttvar) plus
+expected response transmission time. Timeout is bounded by MODBUSRTU_TIMEOUT_MIN and MODBUSRTU_TIMEOUT.
+Slave not responding MODBUSRTU_OFFLINE_COUNT times in a row is considered offline. Requests to offline slave are
+completed with EX_DEVICE_FAILED_TO_RESPOND without being sent except one probe each MODBUSRTU_PROBE_INTERVAL mS.
+*/
+//#define MODBUSRTU_ADAPTIVE_TIMEOUT
+#define MODBUSRTU_TIMEOUT_MIN 20
+#define MODBUSRTU_OFFLINE_COUNT 3
+#define MODBUSRTU_PROBE_INTERVAL 10000
+/*
+#define MODBUSRTU_STATS
+Collect slave turnaround time statistics. Last request timestamps (last byte received, dispatch, transmission start
+and end) and per function code histograms of time from last byte of request to start of response. See latency().
+Histogram buckets are power of two: bucket n counts times of 2^n..2^(n+1)-1 uS, the last one is open-ended.
+*/
+//#define MODBUSRTU_STATS
+#define MODBUSRTU_STATS_BUCKETS 16
+/*
+#define MODBUSRTU_FRAME_STATS
+Count receive framing errors: inter-character gaps over 1.5 char (t1.5), CRC failures, overruns, truncated frames and
+frames split by gap exceeding inter-frame time (bad frame followed by bad one within two inter-frame times).
+Gaps are measured at task() polling resolution. Frames addressed to other slaves are CRC checked as well.
+Optionally inter-frame time is raised to cover observed split gap. See frameStats() and autoInterFrameTime().
+*/
+//#define MODBUSRTU_FRAME_STATS
 /*
 #define MODBUSRTU_REDE
 Enable using separate pins for RE DE
@@ -115,6 +255,8 @@ Enable using separate pins for RE DE
 // Define for internal use. Do not change.
 #define MODBUSRTU_TIMEOUT_US 1000UL * MODBUSRTU_TIMEOUT
 #define MODBUSRTU_MAX_READ_US 1000UL * MODBUSRTU_MAX_READMS
+#define MODBUSRTU_TIMEOUT_MIN_US 1000UL * MODBUSRTU_TIMEOUT_MIN
+#define MODBUSRTU_PROBE_INTERVAL_US 1000UL * MODBUSRTU_PROBE_INTERVAL
 
 /*
 #defone MODBUSRTU_FLUSH_DELAY 1
@@ -128,6 +270,86 @@ Specified in chars. That is 1 is means to add delay enough to send 1 char at cur
 #define MODBUSAPI_LEGACY
 #define MODBUSAPI_OPTIONAL
 
+/*
+#define MODBUSAPI_PLAN_GAP 8
+Default gap tolerance of ModbusReadPlan. Up to specified count of registers not used by any tag are read
+to merge neighbour tags into single request. Each extra register costs 2 bytes (or 1 bit for coils and
+inputs) on the wire, each extra request costs full round trip.
+*/
+#define MODBUSAPI_PLAN_GAP 8
+
+/*
+#define MODBUSAPI_THREADS
+std::mutex and std::condition_variable are available (ESP32 FreeRTOS pthreads, host). Enables ModbusRequestQueue
+to submit client requests from any task or thread while single bus owner task calls task().
+*/
+#if defined(MODBUS_USE_STL) && (defined(ESP32) || defined(ARDUINO_ARCH_HOST))
+#define MODBUSAPI_THREADS
+#endif
+
+/*
+#define MODBUSAPI_THREAD_QUEUE 32
+Default count of requests ModbusRequestQueue holds waiting for the bus owner task. submit() fails and call()
+blocks while queue is full.
+*/
+#define MODBUSAPI_THREAD_QUEUE 32
+
+/*
+#define MODBUSAPI_CACHE 16
+Client reads (readHreg(), readIreg(), readCoil(), readIsts() and read() with value buffer) are answered from
+memory if the same or wider range of the same slave was read within cacheTtl() ms. Writes sent by this client
+drop cached ranges they overlap. Up to specified count of responses are kept, oldest one is replaced.
+Requires STL.
+*/
+//#define MODBUSAPI_CACHE 16
+#if defined(MODBUSAPI_CACHE) && !defined(MODBUS_USE_STL)
+#undef MODBUSAPI_CACHE
+#endif
+#if defined(MODBUSAPI_CACHE)
+#define MODBUSAPI_CACHE_ID 0xFFFF	// Transaction id returned for read answered from cache, never used by ModbusTCP
+#endif
+
+/*
+#define MODBUSAPI_CACHE_TTL 100
+Default time cached response is valid, ms. Set at runtime with cacheTtl(), 0 disables cache.
+*/
+#define MODBUSAPI_CACHE_TTL 100
+
+/*
+#define MODBUSGW_QUEUE 32
+Requests ModbusGateway keeps waiting for each ModbusRTU bus. Requests over the limit are replied with
+EX_SLAVE_DEVICE_BUSY.
+*/
+#define MODBUSGW_QUEUE 32
+
+/*
+#define MODBUSGW_QUEUE_TIMEOUT 3000
+Requests waiting for the bus longer (ms) are replied with EX_DEVICE_FAILED_TO_RESPOND without being sent,
+as client has most likely timed out. Set at runtime with queueTimeout().
+*/
+#define MODBUSGW_QUEUE_TIMEOUT 3000
+
+/*
+#define MODBUSGW_BROADCAST_DELAY 100
+Time (ms) bus is kept quiet after broadcast write is sent to let slaves process it before next request. No
+response marks end of broadcast and request sent right after it would be merged with it into single frame.
+*/
+#define MODBUSGW_BROADCAST_DELAY 100
+
+/*
+#define MODBUSGW_CACHE 16
+Read responses ModbusGateway keeps to answer repeated reads of the same or narrower range without going to the
+bus. Oldest one is replaced. Responses are cached only for units with non-zero cacheTtl().
+*/
+#define MODBUSGW_CACHE 16
+
+/*
+#define MODBUSGW_CACHE_TTL 0
+Default time cached gateway response is valid, ms. 0 disables cache. Set at runtime for all or single unit
+with cacheTtl().
+*/
+#define MODBUSGW_CACHE_TTL 0
+
 // Workaround for RP2040 flush() bug
 #if defined(ARDUINO_ARCH_RP2040)
 #define MODBUSRTU_FLUSH_DELAY 1
@@ -9,6 +9,8 @@
 #include <ESP8266WiFi.h>
 #elif defined(ESP32)
 #include <WiFi.h>
+#elif defined(ARDUINO_ARCH_HOST)
+#include <WiFi.h>	// POSIX sockets
 #endif
 
 #include "ModbusAPI.h"
@@ -14,23 +14,47 @@
 #ifndef IPADDR_NONE
 #define IPADDR_NONE ((uint32_t)0xffffffffUL)
 #endif
+#if defined(MODBUSIP_NODELAY)
+// Disable Nagle algorithm if CLIENT supports it (WiFiClient does, EthernetClient doesn't)
+template <class C>
+static inline auto modbusSetNoDelay(C* c, int) -> decltype(c->setNoDelay(true), void()) { c->setNoDelay(true); }
+template <class C>
+static inline void modbusSetNoDelay(C*, long) {}
+#endif
+#if defined(MODBUSIP_EPOLL)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif defined(MODBUSIP_POLL)
+#include <sys/poll.h>
+#endif
+#if defined(MODBUSIP_POLL) || defined(MODBUSIP_EPOLL)
+// Socket descriptor if CLIENT provides fd() (WiFiClient on ESP32, host sockets), -1 otherwise
+template <class C>
+static inline auto modbusClientFd(C* c, int) -> decltype(c->fd(), int()) { return c->fd(); }
+template <class C>
+static inline int modbusClientFd(C*, long) { return -1; }
+#endif
 // Callback function Type
 #if defined(MODBUS_USE_STL)
 typedef std::function<bool(IPAddress)> cbModbusConnect;
 typedef std::function<IPAddress(const char*)> cbModbusResolver;
+typedef std::function<uint8_t(IPAddress)> cbModbusWeight;
 #else
 typedef bool (*cbModbusConnect)(IPAddress ip);
 typedef IPAddress (*cbModbusResolver)(const char*);
+typedef uint8_t (*cbModbusWeight)(IPAddress ip);
 #endif
 
 struct TTransaction {
-	uint16_t	transactionId;
+	uint16_t	transactionId = 0;	// 0 - free table slot
 	uint32_t	timestamp;
 	cbTransaction cb = nullptr;
 	uint8_t*	_frame = nullptr;
 	uint8_t*		data = nullptr;
 	TAddress	startreg;
 	Modbus::ResultCode forcedEvent = Modbus::EX_SUCCESS;	// EX_SUCCESS means no forced event here. Forced EX_SUCCESS is not possible.
+	int16_t		prev = -1;	// Neighbours in order of start
+	int16_t		next = -1;
 	bool operator ==(const TTransaction &obj) const {
 		    return transactionId == obj.transactionId;
 	}
@@ -50,22 +74,81 @@ class ModbusTCPTemplate : public Modbus {
 	};
 	cbModbusConnect cbConnect = nullptr;
 	cbModbusConnect cbDisconnect = nullptr;
+	cbModbusWeight cbWeight = nullptr;
 	SERVER* tcpserver = nullptr;
-	CLIENT* tcpclient[MODBUSIP_MAX_CLIENTS];
-	#if MODBUSIP_MAX_CLIENTS <= 8
-	uint8_t tcpServerConnection = 0;
-	#elif MODBUSIP_MAX_CLIENTS <= 16
-	uint16_t tcpServerConnection = 0;
-	#else
-	uint32_t tcpServerConnection = 0;
-	#endif
-	#if defined(MODBUS_USE_STL)
-	std::vector<TTransaction> _trans;
-	#else
-	DArray<TTransaction, 2, 2> _trans;
+	struct TConnection {
+		CLIENT*	client;		// nullptr if slot is free
+		CLIENT*	spare;		// Object of closed connection kept for reuse by next one in the slot
+		uint32_t	ip;		// Remote IP. Key of connection index
+		bool	server;		// Incoming connection. Remote side is master
+		int16_t	next;		// Next slot in index bucket or in free slots list
+		int16_t	prev;		// Previous slot in index bucket
+		uint8_t*	rxbuf;	// Reassembly buffer. Allocated on first data, keeps partial frame between task() calls
+		uint16_t	rxlen;
+		uint16_t	rxskip;	// Bytes of oversized frame to drop on arrival
+		uint8_t*	txbuf;	// Responses are collected and sent at once at end of task() pass
+		uint16_t	txlen;	// Unsent tail is kept and sent once socket is writable
+		bool	txWait;		// Waiting for socket to be writable
+		uint8_t	weight;		// Multiplier of per pass request quota and of rate limit
+		uint32_t	tokens;		// Rate limit bucket
+		uint32_t	tokenTime;	// millis() of last bucket refill
+		uint32_t	lastActive;	// millis() of last request
+		int16_t	lruPrev;	// Incoming connections are linked in order of last activity
+		int16_t	lruNext;
+		uint32_t	serial;	// Unique id of connection: slot reuse count << 16 | slot, kept after close
+		#if defined(MODBUSIP_EPOLL)
+		int	fd;		// Socket registered to epoll, -1 if not known yet
+		bool	pending;	// Slot is in connPending list
+		#endif
+	};
+	// Connection table grows on demand up to MODBUSIP_MAX_CLIENTS. Free slots are linked to list,
+	// used ones are hashed by remote IP to index of the same size as table.
+	TConnection* conn = nullptr;
+	int16_t* connIndex = nullptr;
+	uint16_t connCount = 0;	// Allocated slots
+	int16_t connFree = -1;	// First free slot
+	uint16_t connRound = 0;	// Slot to start pass from, rotated so the same connections are not always last
+	uint16_t rateLimitRate = 0;	// Requests per second per incoming connection, 0 - not limited
+	uint16_t rateLimitBurst = 0;
+	bool rateAllow(int16_t i);	// Take token from connection bucket
+	int16_t connBySerial(uint32_t connection);	// Slot of connected client with given id or -1
+	int16_t connLruHead = -1;	// Least recently active incoming connection
+	int16_t connLruTail = -1;
+	uint32_t connIdleTimeout = 0;
+	void connTouch(int16_t i);	// Mark incoming connection as most recently active
+	void connLruUnlink(int16_t i);
+	bool connEvict();	// Drop least recently active incoming connection if it's idle for MODBUSIP_EVICT_IDLE
+	#if defined(MODBUSIP_EPOLL)
+	int connEpoll = -1;
+	struct epoll_event* connEvents = nullptr;	// connCount + 1 entries, server socket is reported as CONN_LISTENER
+	int connListen = -1;	// Server socket registered to epoll
+	static const uint32_t CONN_LISTENER = 0xFFFF;
+	bool connEpollOpen(uint16_t count);
+	int16_t* connPending = nullptr;	// Slots to visit on next pass regardless of socket events
+	uint16_t connPendingCount = 0;
+	void connWatch(int16_t i);	// Register connection socket to epoll once it's known
+	void connDefer(int16_t i);
+	#elif defined(MODBUSIP_POLL)
+	struct pollfd* connPoll = nullptr;	// Socket per slot, -1 if slot is free or socket is unknown
 	#endif
+	// Transaction table. Transaction is kept in slot transactionId % MODBUSIP_MAX_TRANSACTIONS, so response lookup is O(1).
+	// Used slots are linked in order of start. As timeout is the same for all transactions the oldest one expires first
+	// and only head of the list is to be checked.
+	TTransaction _trans[MODBUSIP_MAX_TRANSACTIONS];
+	uint16_t _transCount = 0;
+	int16_t _transHead = -1;	// Oldest transaction
+	int16_t _transTail = -1;
+	void transFree(TTransaction* t);	// Remove transaction from table. _frame is to be freed by caller
 	int16_t		transactionId = 1;  // Last started transaction. Increments on unsuccessful transaction start too.
-	int8_t n = -1;
+	void transactionIdValid() {	// Skip 0 that marks free table slot and id reserved for cached responses
+		while (!transactionId
+	#if defined(MODBUSAPI_CACHE)
+			|| (uint16_t)transactionId == MODBUSAPI_CACHE_ID
+	#endif
+			)
+			transactionId++;
+	}
+	int16_t n = -1;
 	bool autoConnectMode = false;
 	uint16_t serverPort = 0;
 	uint16_t defaultPort = MODBUSTCP_PORT;
@@ -73,10 +156,30 @@ class ModbusTCPTemplate : public Modbus {
 	TTransaction* searchTransaction(uint16_t id);
 	void cleanupConnections();	// Free clients if not connected
 	void cleanupTransactions();	// Remove timedout transactions and forced event
+	void taskClient(uint32_t taskStart);	// Process incoming data of connection n
+	void acceptClients(uint32_t taskStart);
 
-	int8_t getFreeClient();    // Returns free slot position
-	int8_t getSlave(IPAddress ip);
-	int8_t getMaster(IPAddress ip);
+	static const uint16_t rxCapacity = 7 + MODBUSIP_MAXFRAME;	// MBAP + PDU
+	bool rxFill(int16_t i);	// Read available data to buffer without blocking. Returns false if no buffer
+	void rxConsume(int16_t i, uint16_t count);
+	void rxDrop(int16_t i);	// Drop buffered and all incoming data
+	void txAppend(int16_t i, uint8_t* mbap, uint8_t* pdu, uint16_t len);
+	void txFlush(int16_t i);	// Send buffered responses, keep part socket doesn't accept without blocking
+	void txWatch(int16_t i);	// Watch socket for writability while unsent data is kept
+	void txOverflow(int16_t i);	// Drop connection which doesn't read responses
+	void freeBuffers(int16_t i);	// Free receive and transmit buffers of connection
+
+	bool connGrow();	// Double connection table size
+	uint16_t connHash(uint32_t ip) { ip ^= ip >> 16; ip *= 0x45D9F3BUL; ip ^= ip >> 16; return ip % connCount; }
+	int16_t connFind(IPAddress ip, bool server);
+	void connLink(int16_t i);	// Add slot to index
+	void connUnlink(int16_t i);
+	int16_t addClient(IPAddress ip, bool server, const CLIENT* from = nullptr);	// Take slot and client object, copy of from if set.
+	// Returns slot position or -1 if table is full
+	void dropClient(int16_t i);	// Close connection and free slot. Client object is kept in slot
+	void connOpened(int16_t i);	// Set up socket of outgoing connection once client connect() succeeded
+	int16_t getSlave(IPAddress ip) { return connFind(ip, false); }
+	int16_t getMaster(IPAddress ip) { return connFind(ip, true); }
 	public:
 	uint16_t send(String host, TAddress startreg, cbTransaction cb, uint8_t unit = MODBUSIP_UNIT, uint8_t* data = nullptr, bool waitResponse = true);
 	uint16_t send(const char* host, TAddress startreg, cbTransaction cb, uint8_t unit = MODBUSIP_UNIT, uint8_t* data = nullptr, bool waitResponse = true);
@@ -110,12 +213,45 @@ class ModbusTCPTemplate : public Modbus {
 	inline void begin() { server(); }; 	// Depricated
 	void client();
 	void task();
+#if defined(MODBUSIP_EPOLL)
+	// Event-driven operation. Descriptor gets readable when a connection or server socket has events, so
+	// application may sleep in poll()/select() on it (along with own descriptors) and call task() on wakeup.
+	// task() is to be called without waiting if eventPending() is true. Sleep should be limited by
+	// MODBUSIP_TIMEOUT while client transactions are in progress to get them timed out.
+	int eventFd() { return connEpoll; }
+	bool eventPending() { return connPendingCount || (tcpserver && connListen < 0); }
+#endif
 	void onConnect(cbModbusConnect cb = nullptr);
 	void onDisconnect(cbModbusConnect cb = nullptr);
+	void onWeight(cbModbusWeight cb = nullptr) { cbWeight = cb; }	// Weight of new incoming connection by remote IP
+	void rateLimit(uint16_t rate, uint16_t burst = 0);	// Requests per second from each incoming connection, 0 - no limit
+	// Requests over the limit are replied with EX_SLAVE_DEVICE_BUSY. burst defaults to rate.
+	void idleTimeout(uint32_t ms) { connIdleTimeout = ms; }	// Close incoming connections without requests for ms, 0 - never
 	uint32_t eventSource() override;
+	// Id of connection current frame is received from, 0 if none. Valid in onRaw() and register callbacks
+	uint32_t eventConnection() { return (n >= 0 && n < connCount && conn[n].client) ? conn[n].serial : 0; }
+	// Send response to request received earlier from connection eventConnection() returned, e.g. by gateway once
+	// response is got from downstream. pdu is function code and data. Returns false if connection is closed
+	bool sendResponse(uint32_t connection, uint16_t transactionId, uint8_t unit, uint8_t* pdu, uint16_t len);
+	bool connectionActive(uint32_t connection) { return connBySerial(connection) >= 0; }	// Client of connection id is still connected
 	void autoConnect(bool enabled = true);
 	void dropTransactions();
 	uint16_t setTransactionId(uint16_t);
+#if defined(MODBUSIP_UNIT_BANKS)
+	protected:
+	// Register bank per unit id, nullptr if requests are served from default registers. Table of 256 entries is
+	// allocated by first addUnit(), so server without units doesn't pay for it
+	TRegisters** _units = nullptr;
+	TRegisters* unitBank(uint8_t unit) { return _units ? _units[unit] : nullptr; }
+	bool _unitFallback = true;
+	public:
+	bool addUnit(uint8_t unit);	// Create separate register bank for unit id
+	bool removeUnit(uint8_t unit);
+	bool unit(int16_t unit);	// Select bank for following register API calls. -1 selects default registers
+	void unitFallback(bool enabled) { _unitFallback = enabled; }
+	// Serve requests to unit ids without bank from default registers (default) or reply with EX_PATH_UNAVAILABLE.
+	// Unit ids 0 and 255 are always served from default registers.
+#endif
 	#if defined(MODBUS_USE_STL)
 	static IPAddress defaultResolver(const char*) {return IPADDR_NONE;}
 	#else
@@ -126,8 +262,6 @@ class ModbusTCPTemplate : public Modbus {
 template <class SERVER, class CLIENT>
 ModbusTCPTemplate<SERVER, CLIENT>::ModbusTCPTemplate() {
 	//_trans.reserve(MODBUSIP_MAX_TRANSACIONS);
-	for (uint8_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++)
-		tcpclient[i] = nullptr;
 	resolve = defaultResolver;
 }
 
@@ -144,6 +278,18 @@ void ModbusTCPTemplate<SERVER, CLIENT>::server(uint16_t port) {
 		serverPort = defaultPort;
 	tcpserver = new SERVER(serverPort);
 	tcpserver->begin();
+#if defined(MODBUSIP_EPOLL)
+	// Server socket is watched too, so accept() is called only if connection is pending
+	int fd = modbusClientFd(tcpserver, 0);
+	if (fd >= 0 && connEpollOpen(connCount)) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = 0;
+		ev.data.u32 = CONN_LISTENER;
+		if (epoll_ctl(connEpoll, EPOLL_CTL_ADD, fd, &ev) == 0)
+			connListen = fd;
+	}
+#endif
 }
 
 #if defined(MODBUSIP_USE_DNS)
@@ -165,28 +311,39 @@ bool ModbusTCPTemplate<SERVER, CLIENT>::connect(IPAddress ip, uint16_t port) {
 		return false;
 	if(getSlave(ip) != -1)
 		return true;
-	int8_t p = getFreeClient();
+	int16_t p = addClient(ip, false);
 	if (p == -1)
 		return false;
-	tcpclient[p] = new CLIENT();
-	BIT_CLEAR(tcpServerConnection, p);
+	CLIENT* c = conn[p].client;
 #if defined(ESP32) && defined(MODBUSIP_CONNECT_TIMEOUT)
-	if (!tcpclient[p]->connect(ip, port?port:defaultPort, MODBUSIP_CONNECT_TIMEOUT)) {
+	if (!c->connect(ip, port?port:defaultPort, MODBUSIP_CONNECT_TIMEOUT)) {
 #else
-	if (!tcpclient[p]->connect(ip, port?port:defaultPort)) {
+	if (!c->connect(ip, port?port:defaultPort)) {
 #endif
-		delete(tcpclient[p]);
-		tcpclient[p] = nullptr;
+		dropClient(p);
 		return false;
 	}
+	connOpened(p);
 	return true;
 }
 
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::connOpened(int16_t i) {
+#if defined(MODBUSIP_NODELAY)
+	modbusSetNoDelay(conn[i].client, 0);
+#endif
+#if defined(MODBUSIP_EPOLL)
+	connWatch(i);	// Socket is created by connect()
+#elif defined(MODBUSIP_POLL)
+	connPoll[i].fd = modbusClientFd(conn[i].client, 0);	// Socket is created by connect()
+#endif
+}
+
 template <class SERVER, class CLIENT>
 uint32_t ModbusTCPTemplate<SERVER, CLIENT>::eventSource() {		// Returns IP of current processing client query
-	if (n >= 0 && n < MODBUSIP_MAX_CLIENTS && tcpclient[n])
+	if (n >= 0 && n < connCount && conn[n].client)
 	#if !defined(ethernet_h)
-		return (uint32_t)tcpclient[n]->remoteIP();
+		return (uint32_t)conn[n].client->remoteIP();
 	#else
 		return 1;
 	#endif
@@ -195,179 +352,287 @@ uint32_t ModbusTCPTemplate<SERVER, CLIENT>::eventSource() {		// Returns IP of cu
 
 template <class SERVER, class CLIENT>
 TTransaction* ModbusTCPTemplate<SERVER, CLIENT>::searchTransaction(uint16_t id) {
-#define MODBUSIP_COMPARE_TRANS [id](TTransaction& trans){return trans.transactionId == id;}
-	#if defined(MODBUS_USE_STL)
-	std::vector<TTransaction>::iterator it = std::find_if(_trans.begin(), _trans.end(), MODBUSIP_COMPARE_TRANS);
-   	if (it != _trans.end()) return &*it;
-	return nullptr;
-	#else
-	return _trans.entry(_trans.find(MODBUSIP_COMPARE_TRANS));
-	#endif
+	if (!id)
+		return nullptr;
+	TTransaction* t = &_trans[id % MODBUSIP_MAX_TRANSACTIONS];
+	return t->transactionId == id ? t : nullptr;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::transFree(TTransaction* t) {
+	if (t->prev != -1)
+		_trans[t->prev].next = t->next;
+	else
+		_transHead = t->next;
+	if (t->next != -1)
+		_trans[t->next].prev = t->prev;
+	else
+		_transTail = t->prev;
+	t->transactionId = 0;
+	t->_frame = nullptr;
+	_transCount--;
 }
 
 template <class SERVER, class CLIENT>
 void ModbusTCPTemplate<SERVER, CLIENT>::task() {
-	MBAP_t _MBAP;
 	uint32_t taskStart = millis();
-	cleanupConnections();
-	if (tcpserver) {
-		CLIENT c;
-		// WiFiServer.available() == Ethernet.accept() and should wrapped to get code to be compatible with Ethernet library (See ModbusTCP.h code).
-		// WiFiServer.available() != Ethernet.available() internally
+#if !defined(MODBUSIP_POLL) && !defined(MODBUSIP_EPOLL)
+	cleanupConnections();	// Closed connections are found on socket events otherwise
+#endif
+#if !defined(MODBUSIP_EPOLL)
+	acceptClients(taskStart);
+#endif
+#if defined(MODBUSIP_EPOLL)
+	// Connections left with buffered frames or without known socket go first, then ones reported by epoll
+	uint16_t pending = connPendingCount;
+	for (uint16_t k = 0; k < pending; k++) {
+		n = connPending[k];
+		conn[n].pending = false;
+		if (conn[n].client)
+			taskClient(taskStart);
+	}
+	if (pending) {
+		connPendingCount -= pending;	// Keep slots deferred during this pass
+		memmove(connPending, connPending + pending, connPendingCount * sizeof(int16_t));
+	}
+	int ready = connEpoll >= 0 ? epoll_wait(connEpoll, connEvents, connCount + 1, 0) : 0;
+	bool acceptReady = connListen < 0;	// Server socket without descriptor is queried on each call
+	for (int k = 0; k < ready; k++)
+		if (connEvents[k].data.u32 == CONN_LISTENER)
+			acceptReady = true;
+	if (acceptReady)
+		acceptClients(taskStart);
+	for (int k = 0; k < ready; k++) {
+		if (connEvents[k].data.u32 == CONN_LISTENER)
+			continue;
+		n = connEvents[k].data.u32;
+		if (conn[n].client)
+			taskClient(taskStart);
+	}
+#elif defined(MODBUSIP_POLL)
+	if (connCount)
+		::poll(connPoll, connCount, 0);
+	for (uint16_t k = 0; k < connCount; k++) {
+		n = (connRound + k) % connCount;
+		if (!conn[n].client) continue;
+		// Visit connection only if socket has events or complete frames are left buffered on previous pass.
+		// Data buffered inside CLIENT is always read to rxbuf unless it's holding at least MBAP.
+		// Connections without known socket are visited on each pass.
+		if (connPoll[n].fd >= 0 && !connPoll[n].revents && conn[n].rxlen < sizeof(MBAP_t)) continue;
+		connPoll[n].revents = 0;
+		taskClient(taskStart);
+	}
+#else
+	for (uint16_t k = 0; k < connCount; k++) {
+		n = (connRound + k) % connCount;
+		if (conn[n].client)
+			taskClient(taskStart);
+	}
+#endif
+#if !defined(MODBUSIP_EPOLL)
+	if (connCount)
+		connRound = (connRound + 1) % connCount;
+#endif
+	n = -1;
+	while (connIdleTimeout && connLruHead != -1 && millis() - conn[connLruHead].lastActive > connIdleTimeout) {
+		dropClient(connLruHead);
+		if (cbDisconnect && cbEnabled)
+			cbDisconnect(IPADDR_NONE);
+	}
+	cleanupTransactions();
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::acceptClients(uint32_t taskStart) {
+	if (!tcpserver)
+		return;
+	CLIENT c;
+	uint16_t budget = MODBUSIP_MAX_ACCEPT;
+	// WiFiServer.available() == Ethernet.accept() and should wrapped to get code to be compatible with Ethernet library (See ModbusTCP.h code).
+	// WiFiServer.available() != Ethernet.available() internally
 #if defined(MODBUSIP_USE_AVAILABLE)
-		while (millis() - taskStart < MODBUSIP_MAX_READMS && (c = tcpserver->available())) {
+	while (budget-- && millis() - taskStart < MODBUSIP_MAX_READMS && (c = tcpserver->available())) {
 #else
-		while (millis() - taskStart < MODBUSIP_MAX_READMS && (c = tcpserver->accept())) {
+	while (budget-- && millis() - taskStart < MODBUSIP_MAX_READMS && (c = tcpserver->accept())) {
 #endif
 #if defined(MODBUSIP_DEBUG)
-			Serial.println("IP: Accepted");
+		Serial.println("IP: Accepted");
 #endif
-			CLIENT* currentClient = new CLIENT(c);
-			if (!currentClient || !currentClient->connected()) {
-				delete currentClient;
-				continue;
-			}
+		if (!c.connected())
+			continue;
 #if defined(MODBUSRTU_DEBUG)
-			Serial.println("IP: Connected");
-#endif
-			if (cbConnect == nullptr || cbConnect(currentClient->remoteIP())) {
-				#if defined(MODBUSIP_UNIQUE_CLIENTS)
-				// Disconnect previous connection from same IP if present
-				n = getMaster(currentClient->remoteIP());
-				if (n != -1) {
-					tcpclient[n]->flush();
-					delete tcpclient[n];
-					tcpclient[n] = nullptr;
+		Serial.println("IP: Connected");
+#endif
+		if (cbConnect == nullptr || cbConnect(c.remoteIP())) {
+			#if defined(MODBUSIP_UNIQUE_CLIENTS)
+			// Disconnect previous connection from same IP if present
+			n = getMaster(c.remoteIP());
+			if (n != -1) {
+				conn[n].client->flush();
+				dropClient(n);
+			}
+			#endif
+			n = addClient(c.remoteIP(), true, &c);	// Client object of previous connection in the slot is reused
+			if (n == -1 && connEvict())
+				n = addClient(c.remoteIP(), true, &c);
+			if (n > -1) {
+				if (cbWeight) {
+					conn[n].weight = cbWeight(c.remoteIP());
+					if (!conn[n].weight)
+						conn[n].weight = 1;
+					conn[n].tokens = (uint32_t)rateLimitBurst * conn[n].weight;
 				}
-				#endif
-				n = getFreeClient();
-				if (n > -1) {
-					tcpclient[n] = currentClient;
-					BIT_SET(tcpServerConnection, n);
+#if defined(MODBUSIP_NODELAY)
+				modbusSetNoDelay(conn[n].client, 0);
+#endif
 #if defined(MODBUSIP_DEBUG)
-					Serial.print("IP: Conn ");
-					Serial.println(n);
+				Serial.print("IP: Conn ");
+				Serial.println(n);
 #endif
 #if defined(MODBUSIP_USE_AVAILABLE)
-					break;	// while
+				break;	// while
 #else
-					continue; // while
+				continue; // while
 #endif
-				}
 			}
-			// Close connection if callback returns false or MODBUSIP_MAX_CLIENTS reached
-			delete currentClient;
 		}
+		// Close connection if callback returns false or MODBUSIP_MAX_CLIENTS reached
+		c.stop();
 	}
-	for (n = 0; n < MODBUSIP_MAX_CLIENTS; n++) {
-		if (!tcpclient[n]) continue;
-		if (!tcpclient[n]->connected()) continue;
-		while ((size_t)tcpclient[n]->available() > sizeof(_MBAP) && millis() - taskStart < MODBUSIP_MAX_READMS) {
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::taskClient(uint32_t taskStart) {
+	MBAP_t _MBAP;
+#if defined(MODBUSIP_POLL) || defined(MODBUSIP_EPOLL)
+	if (!conn[n].client->connected()) {	// Closed connection is found on socket event
+		dropClient(n);
+		if (cbDisconnect && cbEnabled)
+			cbDisconnect(IPADDR_NONE);
+		return;
+	}
+#if defined(MODBUSIP_EPOLL)
+	connWatch(n);
+#else
+	connPoll[n].fd = modbusClientFd(conn[n].client, 0);
+#endif
+#else
+	if (!conn[n].client->connected()) return;
+#endif
+	txFlush(n);	// Rest of responses socket didn't accept on previous pass
+	rxFill(n);
+	uint16_t quota = MODBUSIP_PASS_REQUESTS * conn[n].weight;	// Rest of frames are left for next pass
+	while (quota-- && conn[n].rxlen >= sizeof(_MBAP.raw) && millis() - taskStart < MODBUSIP_MAX_READMS) {
 #if defined(MODBUSIP_DEBUG)
-			Serial.print(n);
-			Serial.print(": Bytes available ");
-			Serial.println(tcpclient[n]->available());
-#endif
-			tcpclient[n]->readBytes(_MBAP.raw, sizeof(_MBAP.raw));	// Get MBAP
-		
-			if (__swap_16(_MBAP.protocolId) != 0) {   // Check if MODBUSIP packet. __swap is usless there.
-				while (tcpclient[n]->available())	// Drop all incoming if wrong packet
-					tcpclient[n]->read();
-				continue;
-			}
-			_len = __swap_16(_MBAP.length);
-			if (_len < MODBUSIP_MINFRAME) {	// Length is shorter than MODBUSIP_MINFRAME
-				Modbus::FunctionCode fc = FC_READ_COILS; // Just placeholder
-				while (tcpclient[n]->available())	// Drop rest of the packet
-					tcpclient[n]->read();
-				exceptionResponse(fc, EX_ILLEGAL_VALUE);
-			}
+		Serial.print(n);
+		Serial.print(": Bytes buffered ");
+		Serial.println(conn[n].rxlen);
+#endif
+		memcpy(_MBAP.raw, conn[n].rxbuf, sizeof(_MBAP.raw));	// Get MBAP
+		if (conn[n].server)
+			connTouch(n);
+		if (__swap_16(_MBAP.protocolId) != 0) {   // Check if MODBUSIP packet. __swap is usless there.
+			rxDrop(n);	// Drop all incoming if wrong packet
+			break;
+		}
+		_len = __swap_16(_MBAP.length);
+		if (_len < MODBUSIP_MINFRAME) {	// Length is shorter than MODBUSIP_MINFRAME
+			Modbus::FunctionCode fc = FC_READ_COILS; // Just placeholder
+			rxDrop(n);	// Drop rest of the packet
+			exceptionResponse(fc, EX_ILLEGAL_VALUE);
+		}
+		else if (_len - 1 > MODBUSIP_MAXFRAME) {	// Length is over MODBUSIP_MAXFRAME
+			if (conn[n].rxlen == sizeof(_MBAP.raw))
+				break;	// Wait for function code
+			Modbus::FunctionCode fc = (Modbus::FunctionCode)conn[n].rxbuf[sizeof(_MBAP.raw)];
+			rxConsume(n, sizeof(_MBAP.raw) + _len - 1);	// Drop the packet. Part not received yet is skipped on arrival
+			exceptionResponse(fc, EX_SLAVE_FAILURE);
+		}
+		else if (conn[n].rxlen < sizeof(_MBAP.raw) + _len - 1) {
+			break;	// Keep partial frame till next task() call
+		}
+		else if (conn[n].server && !rateAllow(n)) {	// Rate limit exceeded. Frame is not passed to onRaw() nor processed
+			Modbus::FunctionCode fc = (Modbus::FunctionCode)conn[n].rxbuf[sizeof(_MBAP.raw)];
+			rxConsume(n, sizeof(_MBAP.raw) + _len - 1);
+			exceptionResponse(fc, EX_SLAVE_DEVICE_BUSY);
+		}
+		else {
 			_len--; // Do not count with last byte from MBAP
-			if (_len > MODBUSIP_MAXFRAME) {	// Length is over MODBUSIP_MAXFRAME
-			    Modbus::FunctionCode fc = (Modbus::FunctionCode)tcpclient[n]->read();
-				_len--;	// Subtract for read byte
-				for (uint8_t i = 0; tcpclient[n]->available() && i < _len; i++)	// Drop rest of the packet
-					tcpclient[n]->read();
-				exceptionResponse(fc, EX_SLAVE_FAILURE);
+			uint16_t frameLen = sizeof(_MBAP.raw) + _len;
+			free(_frame);
+			_frame = (uint8_t*) malloc(_len);
+			if (!_frame) {
+				exceptionResponse((Modbus::FunctionCode)conn[n].rxbuf[sizeof(_MBAP.raw)], EX_SLAVE_FAILURE);
 			}
 			else {
-				free(_frame);
-				_frame = (uint8_t*) malloc(_len);
-				if (!_frame) {
-			    	Modbus::FunctionCode fc = (Modbus::FunctionCode)tcpclient[n]->read();
-					_len--;	// Subtract for read byte
-					for (uint8_t i = 0; tcpclient[n]->available() && i < _len; i++)	// Drop rest of the packet
-						tcpclient[n]->read();
-					exceptionResponse(fc, EX_SLAVE_FAILURE);
+				memcpy(_frame, conn[n].rxbuf + sizeof(_MBAP.raw), _len);
+				_reply = EX_PASSTHROUGH;
+				// Note on _reply usage
+				// it's used and set as ReplyCode by slavePDU and as exceptionCode by masterPDU
+				if (_cbRaw) {
+					frame_arg_t transData = { _MBAP.unitId, conn[n].client->remoteIP(), __swap_16(_MBAP.transactionId), conn[n].server };
+					_reply = _cbRaw(_frame, _len, &transData);
 				}
-				else {
-					if (tcpclient[n]->readBytes(_frame, _len) < _len) {	// Try to read MODBUS frame
-						exceptionResponse((Modbus::FunctionCode)_frame[0], EX_ILLEGAL_VALUE);
-						//while (tcpclient[n]->available())	// Drop all incoming (if any)
-						//	tcpclient[n]->read();
+				if (conn[n].server) {
+#if defined(MODBUSIP_UNIT_BANKS)
+					if (_reply == EX_PASSTHROUGH) {
+						TRegisters* bank = _bank;
+						TRegisters* unitRegs = unitBank(_MBAP.unitId);
+						if (unitRegs)
+							_bank = unitRegs;
+						if (unitRegs || _unitFallback || _MBAP.unitId == 0 || _MBAP.unitId == 255)
+							slavePDU(_frame); // Process incoming frame as slave
+						else
+							exceptionResponse((FunctionCode)_frame[0], EX_PATH_UNAVAILABLE);
+						_bank = bank;
 					}
-					else {
-						_reply = EX_PASSTHROUGH;
-						// Note on _reply usage
-						// it's used and set as ReplyCode by slavePDU and as exceptionCode by masterPDU
-						if (_cbRaw) {
-							frame_arg_t transData = { _MBAP.unitId, tcpclient[n]->remoteIP(), __swap_16(_MBAP.transactionId), BIT_CHECK(tcpServerConnection, n) };
-							_reply = _cbRaw(_frame, _len, &transData);
-						}
-						if (BIT_CHECK(tcpServerConnection, n)) {
+#else
+					if (_reply == EX_PASSTHROUGH)
+						slavePDU(_frame); // Process incoming frame as slave
+#endif
+					else
+						_reply = REPLY_OFF;
+				}
+				else {
+					// Process reply to master request
+					TTransaction* trans = searchTransaction(__swap_16(_MBAP.transactionId));
+					if (trans) { // if valid transaction id
+						if ((_frame[0] & 0x7F) == trans->_frame[0]) { // Check if function code the same as requested
 							if (_reply == EX_PASSTHROUGH)
-								slavePDU(_frame); // Process incoming frame as slave
-							else
-								_reply = REPLY_OFF;
+								masterPDU(_frame, trans->_frame, trans->startreg, trans->data);	// Process incoming frame as master
 						}
 						else {
-							// Process reply to master request
-							TTransaction* trans = searchTransaction(__swap_16(_MBAP.transactionId));
-							if (trans) { // if valid transaction id
-								if ((_frame[0] & 0x7F) == trans->_frame[0]) { // Check if function code the same as requested
-									if (_reply == EX_PASSTHROUGH)
-										masterPDU(_frame, trans->_frame, trans->startreg, trans->data);	// Process incoming frame as master
-								}
-								else {
-									_reply = EX_UNEXPECTED_RESPONSE;
-								}
-								if (trans->cb) {
-									trans->cb((ResultCode)_reply, trans->transactionId, nullptr);
-								}
-								free(trans->_frame);
-								#if defined(MODBUS_USE_STL)
-								//_trans.erase(std::remove(_trans.begin(), _trans.end(), *trans), _trans.end() );
-								std::vector<TTransaction>::iterator it = std::find(_trans.begin(), _trans.end(), *trans);
-								if (it != _trans.end())
-									_trans.erase(it);
-								#else
-								size_t r = _trans.find([trans](TTransaction& t){return *trans == t;});
-								_trans.remove(r);
-								#endif
-							}
+							_reply = EX_UNEXPECTED_RESPONSE;
+						}
+						if (trans->cb) {
+							trans->cb((ResultCode)_reply, trans->transactionId, nullptr);
 						}
+						free(trans->_frame);
+						transFree(trans);
 					}
 				}
 			}
-			if (!BIT_CHECK(tcpServerConnection, n)) _reply = REPLY_OFF;	// No replay if it was responce to master
-			if (_reply != REPLY_OFF) {
-				_MBAP.length = __swap_16(_len+1);     // _len+1 for last byte from MBAP					
-				size_t send_len = (uint16_t)_len + sizeof(_MBAP.raw);
-				uint8_t sbuf[send_len];				
-				memcpy(sbuf, _MBAP.raw, sizeof(_MBAP.raw));
-				memcpy(sbuf + sizeof(_MBAP.raw), _frame, _len);
-				tcpclient[n]->write(sbuf, send_len);
-				//tcpclient[n]->flush();
-			}
-			if (_frame) {
-				free(_frame);
-				_frame = nullptr;
-			}
-			_len = 0;
+			rxConsume(n, frameLen);
+		}
+		if (!conn[n].server) _reply = REPLY_OFF;	// No replay if it was responce to master
+		if (_reply != REPLY_OFF) {
+			_MBAP.length = __swap_16(_len+1);     // _len+1 for last byte from MBAP
+			txAppend(n, _MBAP.raw, _frame, _len);
+		}
+		if (_frame) {
+			free(_frame);
+			_frame = nullptr;
 		}
+		_len = 0;
+		if (!conn[n].client) break;	// Connection may be dropped from callback
+		rxFill(n);
 	}
-	n = -1;
-	cleanupTransactions();
+	if (conn[n].client)
+		txFlush(n);	// Send responses to all pipelined requests at once
+#if defined(MODBUSIP_EPOLL)
+	if (conn[n].client && (conn[n].fd < 0 || conn[n].rxlen >= sizeof(_MBAP.raw)))
+		connDefer(n);	// Visit on next pass without waiting for socket event
+#endif
 }
 
 template <class SERVER, class CLIENT>
@@ -384,11 +649,9 @@ template <class SERVER, class CLIENT>
 uint16_t ModbusTCPTemplate<SERVER, CLIENT>::send(IPAddress ip, TAddress startreg, cbTransaction cb, uint8_t unit, uint8_t* data, bool waitResponse) {
 	MBAP_t _MBAP;
 	uint16_t result = 0;
-	int8_t p;
-#if defined(MODBUSIP_MAX_TRANSACTIONS)
-	if (_trans.size() >= MODBUSIP_MAX_TRANSACTIONS)
+	int16_t p;
+	if (_transCount >= MODBUSIP_MAX_TRANSACTIONS)
 		goto cleanup;
-#endif
 	if (!ip)
 		return 0;
 	if (tcpserver) {
@@ -396,11 +659,21 @@ uint16_t ModbusTCPTemplate<SERVER, CLIENT>::send(IPAddress ip, TAddress startreg
 	} else {
 		p = getSlave(ip);
 	}
-	if (p == -1 || !tcpclient[p]->connected()) {
+	if (p == -1) {
 		if (!autoConnectMode)
 			goto cleanup;
 		if (!connect(ip))
 			goto cleanup;
+		p = getSlave(ip);
+		if (p == -1)
+			goto cleanup;
+	}
+	if (waitResponse) {
+		// Skip ids which table slots are still used by older transactions. Free slot exists as table is not full.
+		while (_trans[(uint16_t)transactionId % MODBUSIP_MAX_TRANSACTIONS].transactionId) {
+			transactionId++;
+			transactionIdValid();
+		}
 	}
 	_MBAP.transactionId	= __swap_16(transactionId);
 	_MBAP.protocolId	= __swap_16(0);
@@ -412,26 +685,37 @@ uint16_t ModbusTCPTemplate<SERVER, CLIENT>::send(IPAddress ip, TAddress startreg
 		uint8_t sbuf[send_len];
 		memcpy(sbuf, _MBAP.raw, sizeof(_MBAP.raw));
 		memcpy(sbuf + sizeof(_MBAP.raw), _frame, _len);
-		writeResult = (tcpclient[p]->write(sbuf, send_len) == send_len);
+		size_t sent = conn[p].client->write(sbuf, send_len);
+		writeResult = (sent == send_len);
+		if (sent && !writeResult)
+			dropClient(p);	// Part of request is sent, stream framing is broken
 	}
 	if (!writeResult)
 		goto cleanup;
 	//tcpclient[p]->flush();
 	if (waitResponse) {
-		TTransaction tmp;
-		tmp.transactionId = transactionId;
-		tmp.timestamp = millis();
-		tmp.cb = cb;
-		tmp.data = data;	// BUG: Should data be saved? It may lead to memory leak or double free.
-		tmp._frame = _frame;
-		tmp.startreg = startreg;
-		_trans.push_back(tmp);
+		int16_t i = (uint16_t)transactionId % MODBUSIP_MAX_TRANSACTIONS;
+		TTransaction* tmp = &_trans[i];
+		tmp->transactionId = transactionId;
+		tmp->timestamp = millis();
+		tmp->cb = cb;
+		tmp->data = data;	// BUG: Should data be saved? It may lead to memory leak or double free.
+		tmp->_frame = _frame;
+		tmp->startreg = startreg;
+		tmp->forcedEvent = Modbus::EX_SUCCESS;
+		tmp->prev = _transTail;
+		tmp->next = -1;
+		if (_transTail != -1)
+			_trans[_transTail].next = i;
+		else
+			_transHead = i;
+		_transTail = i;
+		_transCount++;
 		_frame = nullptr;
 	}
 	result = transactionId;
 	transactionId++;
-	if (!transactionId)
-		transactionId = 1;
+	transactionIdValid();
 	cleanup:
 	free(_frame);
 	_frame = nullptr;
@@ -449,14 +733,38 @@ void ModbusTCPTemplate<SERVER, CLIENT>::onDisconnect(cbModbusConnect cb) {
 		cbDisconnect = cb;
 }
 
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::rateLimit(uint16_t rate, uint16_t burst) {
+	rateLimitRate = rate;
+	rateLimitBurst = burst ? burst : rate;
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::rateAllow(int16_t i) {
+	if (!rateLimitRate)
+		return true;
+	uint32_t rate = (uint32_t)rateLimitRate * conn[i].weight;
+	uint32_t burst = (uint32_t)rateLimitBurst * conn[i].weight;
+	uint32_t now = millis();
+	uint64_t add = (uint64_t)(now - conn[i].tokenTime) * rate / 1000;
+	if (conn[i].tokens + add >= burst) {
+		conn[i].tokens = burst;
+		conn[i].tokenTime = now;
+	} else if (add) {
+		conn[i].tokens += add;
+		conn[i].tokenTime += add * 1000 / rate;	// Keep fraction of token for next refill
+	}
+	if (!conn[i].tokens)
+		return false;
+	conn[i].tokens--;
+	return true;
+}
+
 template <class SERVER, class CLIENT>
 void ModbusTCPTemplate<SERVER, CLIENT>::cleanupConnections() {
-	for (uint8_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++) {
-		if (tcpclient[i] && !tcpclient[i]->connected()) {
-			//IPAddress ip = tcpclient[i]->remoteIP();
-			tcpclient[i]->stop();
-			delete tcpclient[i];
-			tcpclient[i] = nullptr;
+	for (int16_t i = 0; i < connCount; i++) {
+		if (conn[i].client && !conn[i].client->connected()) {
+			dropClient(i);
 			if (cbDisconnect && cbEnabled) 
 				cbDisconnect(IPADDR_NONE);
 		}
@@ -465,53 +773,393 @@ void ModbusTCPTemplate<SERVER, CLIENT>::cleanupConnections() {
 
 template <class SERVER, class CLIENT>
 void ModbusTCPTemplate<SERVER, CLIENT>::cleanupTransactions() {
-	#if defined(MODBUS_USE_STL)
-	for (auto it = _trans.begin(); it != _trans.end();) {
-		if (millis() - it->timestamp > MODBUSIP_TIMEOUT || it->forcedEvent != Modbus::EX_SUCCESS) {
-			Modbus::ResultCode res = (it->forcedEvent != Modbus::EX_SUCCESS)?it->forcedEvent:Modbus::EX_TIMEOUT;
-			if (it->cb)
-				it->cb(res, it->transactionId, nullptr);
-			free(it->_frame);
-			it = _trans.erase(it);
-		} else
-			it++;
+	while (_transHead != -1) {
+		TTransaction* t = &_trans[_transHead];
+		if (millis() - t->timestamp <= MODBUSIP_TIMEOUT && t->forcedEvent == Modbus::EX_SUCCESS)
+			break;	// Rest of transactions are started later
+		Modbus::ResultCode res = (t->forcedEvent != Modbus::EX_SUCCESS)?t->forcedEvent:Modbus::EX_TIMEOUT;
+		cbTransaction cb = t->cb;
+		uint16_t id = t->transactionId;
+		free(t->_frame);
+		transFree(t);	// Slot is freed before callback to let it start new transaction
+		if (cb)
+			cb(res, id, nullptr);
 	}
-	#else
-	size_t i = 0;
-	while (i < _trans.size()) {
-		TTransaction t =  _trans[i];
-		if (millis() - t.timestamp > MODBUSIP_TIMEOUT || t.forcedEvent != Modbus::EX_SUCCESS) {
-			Modbus::ResultCode res = (t.forcedEvent != Modbus::EX_SUCCESS)?t.forcedEvent:Modbus::EX_TIMEOUT;
-			if (t.cb)
-				t.cb(res, t.transactionId, nullptr);
-			free(t._frame);
-			_trans.remove(i);
-		} else
-			i++;
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::rxFill(int16_t i) {
+	if (!conn[i].rxbuf) {
+		if (!conn[i].client->available())
+			return false;
+		conn[i].rxbuf = (uint8_t*) malloc(rxCapacity);
+		if (!conn[i].rxbuf)
+			return false;
+		conn[i].rxlen = 0;
 	}
-	#endif
+	int avail = conn[i].client->available();
+	while (conn[i].rxskip && avail > 0) {	// Skip rest of oversized frame
+		uint16_t count = conn[i].rxskip < rxCapacity - conn[i].rxlen ? conn[i].rxskip : rxCapacity - conn[i].rxlen;
+		int r = conn[i].client->read(conn[i].rxbuf + conn[i].rxlen, count < avail ? count : avail);	// Free part of buffer is used as scratch
+		if (r <= 0)
+			return true;
+		conn[i].rxskip -= r;
+		avail -= r;
+	}
+	if (avail > 0 && conn[i].rxlen < rxCapacity) {
+		uint16_t room = rxCapacity - conn[i].rxlen;
+		int r = conn[i].client->read(conn[i].rxbuf + conn[i].rxlen, room < avail ? room : avail);
+		if (r > 0)
+			conn[i].rxlen += r;
+	}
+	return true;
 }
 
 template <class SERVER, class CLIENT>
-int8_t ModbusTCPTemplate<SERVER, CLIENT>::getFreeClient() {
-	for (uint8_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++)
-		if (!tcpclient[i])
-			return i;
-	return -1;
+void ModbusTCPTemplate<SERVER, CLIENT>::rxConsume(int16_t i, uint16_t count) {
+	if (count >= conn[i].rxlen) {
+		conn[i].rxskip += count - conn[i].rxlen;
+		conn[i].rxlen = 0;
+		return;
+	}
+	conn[i].rxlen -= count;
+	memmove(conn[i].rxbuf, conn[i].rxbuf + count, conn[i].rxlen);
 }
 
 template <class SERVER, class CLIENT>
-int8_t ModbusTCPTemplate<SERVER, CLIENT>::getSlave(IPAddress ip) {
-	for (uint8_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++)
-		if (tcpclient[i] && tcpclient[i]->connected() && tcpclient[i]->remoteIP() == ip && !BIT_CHECK(tcpServerConnection, i))
-			return i;
-	return -1;
+void ModbusTCPTemplate<SERVER, CLIENT>::rxDrop(int16_t i) {
+	conn[i].rxlen = 0;
+	conn[i].rxskip = 0;
+	while (conn[i].client->available())
+		conn[i].client->read();
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::freeBuffers(int16_t i) {
+	free(conn[i].rxbuf);
+	conn[i].rxbuf = nullptr;
+	conn[i].rxlen = 0;
+	conn[i].rxskip = 0;
+	free(conn[i].txbuf);
+	conn[i].txbuf = nullptr;
+	conn[i].txlen = 0;
 }
 
 template <class SERVER, class CLIENT>
-int8_t ModbusTCPTemplate<SERVER, CLIENT>::getMaster(IPAddress ip) {
-	for (uint8_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++)
-		if (tcpclient[i] && tcpclient[i]->connected() && tcpclient[i]->remoteIP() == ip && BIT_CHECK(tcpServerConnection, i))
+void ModbusTCPTemplate<SERVER, CLIENT>::txAppend(int16_t i, uint8_t* mbap, uint8_t* pdu, uint16_t len) {
+	if (!conn[i].txbuf)
+		conn[i].txbuf = (uint8_t*) malloc(MODBUSIP_TX_BUFFER);
+	if (!conn[i].txbuf || 7 + len > MODBUSIP_TX_BUFFER) {	// Write directly if can't be buffered
+		txFlush(i);
+		if (conn[i].txlen || conn[i].client->write(mbap, 7) != 7 || conn[i].client->write(pdu, len) != len)
+			txOverflow(i);
+		return;
+	}
+	if (conn[i].txlen + 7 + len > MODBUSIP_TX_BUFFER) {
+		txFlush(i);
+		if (conn[i].txlen + 7 + len > MODBUSIP_TX_BUFFER) {	// Client doesn't read responses
+			txOverflow(i);
+			return;
+		}
+	}
+	memcpy(conn[i].txbuf + conn[i].txlen, mbap, 7);
+	memcpy(conn[i].txbuf + conn[i].txlen + 7, pdu, len);
+	conn[i].txlen += 7 + len;
+}
+
+template <class SERVER, class CLIENT>
+int16_t ModbusTCPTemplate<SERVER, CLIENT>::connBySerial(uint32_t connection) {
+	uint16_t i = connection & 0xFFFF;
+	if (!connection || i >= connCount || !conn[i].client || conn[i].serial != connection)
+		return -1;
+	return conn[i].client->connected() ? i : -1;
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::sendResponse(uint32_t connection, uint16_t transactionId, uint8_t unit, uint8_t* pdu, uint16_t len) {
+	if (!pdu || !len || len > MODBUSIP_MAXFRAME)
+		return false;
+	int16_t i = connBySerial(connection);
+	if (i < 0)
+		return false;
+	MBAP_t mbap;
+	mbap.transactionId = __swap_16(transactionId);
+	mbap.protocolId = 0;
+	mbap.length = __swap_16(len + 1);
+	mbap.unitId = unit;
+	txAppend(i, mbap.raw, pdu, len);
+	txFlush(i);	// May be called outside of task() pass over the connection
+	return conn[i].client != nullptr;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::txFlush(int16_t i) {
+	if (!conn[i].client || !conn[i].txlen)
+		return;
+	size_t sent = conn[i].client->write(conn[i].txbuf, conn[i].txlen);
+	conn[i].txlen -= sent;
+	if (conn[i].txlen && sent)
+		memmove(conn[i].txbuf, conn[i].txbuf + sent, conn[i].txlen);
+	if (conn[i].txWait != (conn[i].txlen > 0)) {
+		conn[i].txWait = conn[i].txlen > 0;
+		txWatch(i);
+	}
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::txWatch(int16_t i) {
+#if defined(MODBUSIP_EPOLL)
+	if (conn[i].fd < 0)
+		return;
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLRDHUP | (conn[i].txWait ? (uint32_t)EPOLLOUT : 0);
+	ev.data.u64 = 0;
+	ev.data.u32 = i;
+	epoll_ctl(connEpoll, EPOLL_CTL_MOD, conn[i].fd, &ev);
+#elif defined(MODBUSIP_POLL)
+	connPoll[i].events = POLLIN | (conn[i].txWait ? POLLOUT : 0);
+#else
+	(void)i;	// Each connection is visited on every task() pass
+#endif
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::txOverflow(int16_t i) {
+	dropClient(i);
+	if (cbDisconnect && cbEnabled)
+		cbDisconnect(IPADDR_NONE);
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::connGrow() {
+	if (connCount >= MODBUSIP_MAX_CLIENTS)
+		return false;
+	uint16_t count = connCount ? connCount * 2 : 4;
+	if (count > MODBUSIP_MAX_CLIENTS)
+		count = MODBUSIP_MAX_CLIENTS;
+	TConnection* c = (TConnection*) realloc(conn, count * sizeof(TConnection));
+	if (!c)
+		return false;
+	conn = c;
+	int16_t* idx = (int16_t*) realloc(connIndex, count * sizeof(int16_t));
+	if (!idx)
+		return false;
+	connIndex = idx;
+#if defined(MODBUSIP_EPOLL)
+	if (!connEpollOpen(count))
+		return false;
+	int16_t* pend = (int16_t*) realloc(connPending, 2 * count * sizeof(int16_t));	// Slot may be deferred again while visited
+	if (!pend)
+		return false;
+	connPending = pend;
+#elif defined(MODBUSIP_POLL)
+	struct pollfd* pfd = (struct pollfd*) realloc(connPoll, count * sizeof(struct pollfd));
+	if (!pfd)
+		return false;
+	connPoll = pfd;
+	for (uint16_t i = connCount; i < count; i++) {
+		connPoll[i].fd = -1;
+		connPoll[i].events = POLLIN;
+		connPoll[i].revents = 0;
+	}
+#endif
+	for (int16_t i = count - 1; i >= connCount; i--) {
+		memset(&conn[i], 0, sizeof(TConnection));
+		#if defined(MODBUSIP_EPOLL)
+		conn[i].fd = -1;
+		#endif
+		conn[i].next = connFree;
+		connFree = i;
+	}
+	connCount = count;
+	// Rehash used slots as bucket count is changed
+	for (uint16_t i = 0; i < connCount; i++)
+		connIndex[i] = -1;
+	for (int16_t i = 0; i < connCount; i++) {
+		if (conn[i].client)
+			connLink(i);
+	}
+	return true;
+}
+
+template <class SERVER, class CLIENT>
+int16_t ModbusTCPTemplate<SERVER, CLIENT>::addClient(IPAddress ip, bool server, const CLIENT* from) {
+	if (connFree == -1 && !connGrow())
+		return -1;
+	int16_t p = connFree;
+	CLIENT* c = conn[p].spare;
+	if (!c)
+		c = from ? new CLIENT(*from) : new CLIENT();
+	else if (from)
+		*c = *from;
+	if (!c)
+		return -1;
+	conn[p].spare = nullptr;
+	connFree = conn[p].next;
+	conn[p].client = c;
+	conn[p].ip = (uint32_t)ip;
+	conn[p].server = server;
+	conn[p].rxbuf = nullptr;
+	conn[p].rxlen = 0;
+	conn[p].rxskip = 0;
+	conn[p].txbuf = nullptr;
+	conn[p].txlen = 0;
+	conn[p].txWait = false;
+	conn[p].weight = 1;
+	conn[p].tokens = rateLimitBurst;
+	conn[p].tokenTime = millis();
+	conn[p].lruPrev = -1;
+	conn[p].lruNext = -1;
+	uint16_t generation = (conn[p].serial >> 16) + 1;
+	conn[p].serial = (uint32_t)(generation ? generation : 1) << 16 | p;
+	connLink(p);
+	if (server)
+		connTouch(p);
+#if defined(MODBUSIP_EPOLL)
+	conn[p].fd = -1;
+	connWatch(p);
+	if (conn[p].fd < 0)
+		connDefer(p);
+#elif defined(MODBUSIP_POLL)
+	connPoll[p].fd = modbusClientFd(c, 0);
+	connPoll[p].revents = 0;
+#endif
+	return p;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::dropClient(int16_t i) {
+#if defined(MODBUSIP_EPOLL)
+	if (conn[i].fd >= 0)
+		epoll_ctl(connEpoll, EPOLL_CTL_DEL, conn[i].fd, nullptr);
+	conn[i].fd = -1;	// Stale entry in connPending list is kept till next pass
+#endif
+	if (conn[i].server)
+		connLruUnlink(i);
+	conn[i].client->stop();
+	conn[i].spare = conn[i].client;
+	conn[i].client = nullptr;
+	conn[i].txWait = false;
+	freeBuffers(i);
+	connUnlink(i);
+	conn[i].next = connFree;
+	connFree = i;
+#if defined(MODBUSIP_POLL)
+	connPoll[i].fd = -1;
+	connPoll[i].events = POLLIN;
+	connPoll[i].revents = 0;
+#endif
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::connTouch(int16_t i) {
+	conn[i].lastActive = millis();
+	if (connLruTail == i)
+		return;
+	if (conn[i].lruPrev != -1 || connLruHead == i)
+		connLruUnlink(i);
+	conn[i].lruPrev = connLruTail;
+	conn[i].lruNext = -1;
+	if (connLruTail != -1)
+		conn[connLruTail].lruNext = i;
+	else
+		connLruHead = i;
+	connLruTail = i;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::connLruUnlink(int16_t i) {
+	if (conn[i].lruPrev != -1)
+		conn[conn[i].lruPrev].lruNext = conn[i].lruNext;
+	else
+		connLruHead = conn[i].lruNext;
+	if (conn[i].lruNext != -1)
+		conn[conn[i].lruNext].lruPrev = conn[i].lruPrev;
+	else
+		connLruTail = conn[i].lruPrev;
+	conn[i].lruPrev = -1;
+	conn[i].lruNext = -1;
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::connEvict() {
+#if MODBUSIP_EVICT_IDLE > 0
+	int16_t i = connLruHead;
+	if (i == -1 || millis() - conn[i].lastActive < MODBUSIP_EVICT_IDLE)
+		return false;
+	dropClient(i);
+	if (cbDisconnect && cbEnabled)
+		cbDisconnect(IPADDR_NONE);
+	return true;
+#else
+	return false;
+#endif
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::connLink(int16_t i) {
+	uint16_t b = connHash(conn[i].ip);
+	conn[i].prev = -1;
+	conn[i].next = connIndex[b];
+	if (conn[i].next != -1)
+		conn[conn[i].next].prev = i;
+	connIndex[b] = i;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::connUnlink(int16_t i) {
+	if (conn[i].prev != -1)
+		conn[conn[i].prev].next = conn[i].next;
+	else
+		connIndex[connHash(conn[i].ip)] = conn[i].next;
+	if (conn[i].next != -1)
+		conn[conn[i].next].prev = conn[i].prev;
+}
+
+#if defined(MODBUSIP_EPOLL)
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::connEpollOpen(uint16_t count) {
+	if (connEpoll < 0)
+		connEpoll = epoll_create1(EPOLL_CLOEXEC);
+	if (connEpoll < 0)
+		return false;
+	struct epoll_event* ev = (struct epoll_event*) realloc(connEvents, (count + 1) * sizeof(struct epoll_event));
+	if (!ev)
+		return false;
+	connEvents = ev;
+	return true;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::connWatch(int16_t i) {
+	if (conn[i].fd >= 0)
+		return;
+	int fd = modbusClientFd(conn[i].client, 0);
+	if (fd < 0)
+		return;
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLRDHUP | (conn[i].txWait ? (uint32_t)EPOLLOUT : 0);
+	ev.data.u64 = 0;
+	ev.data.u32 = i;
+	if (epoll_ctl(connEpoll, EPOLL_CTL_ADD, fd, &ev) == 0)
+		conn[i].fd = fd;
+}
+
+template <class SERVER, class CLIENT>
+void ModbusTCPTemplate<SERVER, CLIENT>::connDefer(int16_t i) {
+	if (conn[i].pending)
+		return;
+	conn[i].pending = true;
+	connPending[connPendingCount++] = i;
+}
+#endif
+
+template <class SERVER, class CLIENT>
+int16_t ModbusTCPTemplate<SERVER, CLIENT>::connFind(IPAddress ip, bool server) {
+	if (!connCount)
+		return -1;
+	for (int16_t i = connIndex[connHash((uint32_t)ip)]; i != -1; i = conn[i].next)
+		if (conn[i].ip == (uint32_t)ip && conn[i].server == server && conn[i].client->connected())
 			return i;
 	return -1;
 }
@@ -536,8 +1184,7 @@ template <class SERVER, class CLIENT>
 bool ModbusTCPTemplate<SERVER, CLIENT>::isConnected(IPAddress ip) {
 	if (!ip)
 		return false;
-	int8_t p = getSlave(ip);
-	return  p != -1 && tcpclient[p]->connected();
+	return getSlave(ip) != -1;
 }
 
 template <class SERVER, class CLIENT>
@@ -561,11 +1208,9 @@ template <class SERVER, class CLIENT>
 bool ModbusTCPTemplate<SERVER, CLIENT>::disconnect(IPAddress ip) {
 	if (!ip)
 		return false;
-	int8_t p = getSlave(ip);
+	int16_t p = getSlave(ip);
 	if (p != -1) {
-		tcpclient[p]->stop();
-		delete tcpclient[p];
-		tcpclient[p] = nullptr;
+		dropClient(p);
 		return true;
 	}
 	return false;
@@ -573,12 +1218,8 @@ bool ModbusTCPTemplate<SERVER, CLIENT>::disconnect(IPAddress ip) {
 
 template <class SERVER, class CLIENT>
 void ModbusTCPTemplate<SERVER, CLIENT>::dropTransactions() {
-	#if defined(MODBUS_USE_STL)
-	for (auto &t : _trans) t.forcedEvent = EX_CANCEL;
-	#else
-	for (size_t i = 0; i < _trans.size(); i++)
-		_trans.entry(i)->forcedEvent = EX_CANCEL;
-	#endif
+	for (int16_t i = _transHead; i != -1; i = _trans[i].next)
+		_trans[i].forcedEvent = EX_CANCEL;
 }
 
 template <class SERVER, class CLIENT>
@@ -590,17 +1231,75 @@ ModbusTCPTemplate<SERVER, CLIENT>::~ModbusTCPTemplate() {
 	cleanupTransactions();
 	delete tcpserver;
 	tcpserver = nullptr;
-	for (uint8_t i = 0; i < MODBUSIP_MAX_CLIENTS; i++) {
-		delete tcpclient[i];
-		tcpclient[i] = nullptr;
+	for (int16_t i = 0; i < connCount; i++) {
+		if (conn[i].client)
+			dropClient(i);
+		delete conn[i].spare;
+	}
+	free(conn);
+	conn = nullptr;
+	free(connIndex);
+	connIndex = nullptr;
+#if defined(MODBUSIP_EPOLL)
+	free(connEvents);
+	connEvents = nullptr;
+	free(connPending);
+	connPending = nullptr;
+	if (connEpoll >= 0)
+		close(connEpoll);
+	connEpoll = -1;
+#elif defined(MODBUSIP_POLL)
+	free(connPoll);
+	connPoll = nullptr;
+#endif
+	connCount = 0;
+#if defined(MODBUSIP_UNIT_BANKS)
+	if (_units) {
+		for (uint16_t i = 0; i < 256; i++)
+			delete _units[i];
+		delete[] _units;
+	}
+#endif
+}
+
+#if defined(MODBUSIP_UNIT_BANKS)
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::addUnit(uint8_t unit) {
+	if (!_units)
+		_units = new TRegisters*[256]();
+	if (!_units[unit])
+		_units[unit] = new TRegisters();
+	return _units[unit] != nullptr;
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::removeUnit(uint8_t unit) {
+	if (!unitBank(unit))
+		return false;
+	if (_bank == _units[unit])
+		_bank = &_regs;
+	delete _units[unit];
+	_units[unit] = nullptr;
+	return true;
+}
+
+template <class SERVER, class CLIENT>
+bool ModbusTCPTemplate<SERVER, CLIENT>::unit(int16_t unit) {
+	if (unit < 0 || unit > 255) {
+		_bank = &_regs;
+		return true;
 	}
+	if (!unitBank(unit))
+		return false;
+	_bank = _units[unit];
+	return true;
 }
+#endif
 
 template <class SERVER, class CLIENT>
 uint16_t ModbusTCPTemplate<SERVER, CLIENT>::setTransactionId(uint16_t t) {
 	transactionId = t;
-	if (!transactionId)
-		transactionId = 1;
+	transactionIdValid();
 	return transactionId;
 }
 
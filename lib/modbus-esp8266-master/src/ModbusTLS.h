@@ -4,11 +4,14 @@
     Copyright (C) 2020 Alexander Emelianov (a.m.emelianov@gmail.com)
 */
 #pragma once
-#if !defined(ESP8266) && !defined(ESP32)
+#if !defined(ESP8266) && !defined(ESP32) && !defined(ARDUINO_ARCH_HOST)
 #error Unsupported architecture
 #endif
+#if defined(ESP8266) || defined(ARDUINO_ARCH_HOST)
+#define MODBUSTLS_BEARSSL	// Host shim follows ESP8266 API
+#endif
 #include <WiFiClientSecure.h>
-#if defined(ESP8266)
+#if defined(MODBUSTLS_BEARSSL)
 #include <WiFiServerSecure.h>
 #else
 // Just emty stub
@@ -27,22 +30,156 @@ public:
 
 class ModbusTLS : public ModbusAPI<ModbusTCPTemplate<WiFiServerSecure, WiFiClientSecure>> {
     private:
-    int8_t _connect(IPAddress ip, uint16_t port, const char* client_cert = nullptr, const char* client_private_key = nullptr) {
-	    int8_t p = getFreeClient();
+    #if defined(MODBUSTLS_BEARSSL)
+    // Parsed credentials are kept by pointer to PEM text and shared by all connections
+    template <class T>
+    struct TCredential {
+        const char* pem = nullptr;
+        T* obj = nullptr;
+    };
+    TCredential<BearSSL::X509List> _certs[MODBUSTLS_CREDENTIALS];
+    TCredential<BearSSL::PrivateKey> _keys[MODBUSTLS_CREDENTIALS];
+    TCredential<BearSSL::PublicKey> _publicKeys[MODBUSTLS_CREDENTIALS];
+    // PEM texts given to outgoing connection of the slot, valid while connection with the id is open
+    struct TUse {
+        uint32_t connection;
+        const char* pem[4];
+    };
+    TUse* _uses = nullptr;
+    uint16_t _usesCount = 0;
+    const char* _serverPem[3] = {nullptr, nullptr, nullptr};
+    bool use(int16_t p, const char* cert, const char* key, const char* ca, const char* known) {
+        if (p >= _usesCount) {
+            TUse* u = (TUse*) realloc(_uses, connCount * sizeof(TUse));
+            if (!u)
+                return false;
+            memset(u + _usesCount, 0, (connCount - _usesCount) * sizeof(TUse));
+            _uses = u;
+            _usesCount = connCount;
+        }
+        _uses[p] = { conn[p].serial, { cert, key, ca, known } };
+        return true;
+    }
+    bool referenced(const char* pem) {
+        for (uint8_t k = 0; k < 3; k++)
+            if (_serverPem[k] == pem)
+                return true;
+        for (uint16_t i = 0; i < _usesCount && i < connCount; i++) {
+            if (!conn[i].client || conn[i].serial != _uses[i].connection)
+                continue;
+            for (uint8_t k = 0; k < 4; k++)
+                if (_uses[i].pem[k] == pem)
+                    return true;
+        }
+        return false;
+    }
+    // Parse PEM or take cached object. If cache is full, entry no open connection or server uses is replaced.
+    // Returns false if all entries are in use
+    template <class T>
+    bool credential(TCredential<T>* cache, const char* pem, T*& obj) {
+        obj = nullptr;
+        if (!pem)
+            return true;
+        TCredential<T>* slot = nullptr;
+        for (uint8_t i = 0; i < MODBUSTLS_CREDENTIALS; i++) {
+            if (cache[i].pem == pem) {
+                obj = cache[i].obj;
+                return true;
+            }
+            if (!cache[i].pem)
+                slot = &cache[i];
+        }
+        for (uint8_t i = 0; i < MODBUSTLS_CREDENTIALS && !slot; i++)
+            if (!referenced(cache[i].pem))
+                slot = &cache[i];
+        if (!slot)
+            return false;
+        delete slot->obj;
+        slot->pem = pem;
+        slot->obj = new T(pem);
+        obj = slot->obj;
+        return true;
+    }
+    template <class T>
+    static void freeCredentials(TCredential<T>* cache) {
+        for (uint8_t i = 0; i < MODBUSTLS_CREDENTIALS; i++) {
+            delete cache[i].obj;
+            cache[i].obj = nullptr;
+            cache[i].pem = nullptr;
+        }
+    }
+    #if MODBUSTLS_SESSIONS > 0
+    // Sessions of remote servers, replaced in round-robin order. Resumed handshake skips server verification,
+    // so session is reused only with the same authentication (CA certificate or known key PEM, insecure if none)
+    struct TSession {
+        uint32_t ip = 0;
+        uint16_t port = 0;
+        const char* auth = nullptr;
+        bool knownKey = false;
+        BearSSL::Session* session = nullptr;
+    };
+    TSession _sessions[MODBUSTLS_SESSIONS];
+    uint8_t _sessionNext = 0;
+    BearSSL::Session* session(IPAddress ip, uint16_t port, const char* auth, bool knownKey) {
+        for (uint8_t i = 0; i < MODBUSTLS_SESSIONS; i++)
+            if (_sessions[i].session && _sessions[i].ip == (uint32_t)ip && _sessions[i].port == port
+                && _sessions[i].auth == auth && _sessions[i].knownKey == knownKey)
+                return _sessions[i].session;
+        TSession* s = &_sessions[_sessionNext];
+        _sessionNext = (_sessionNext + 1) % MODBUSTLS_SESSIONS;
+        delete s->session;  // Session is used by client within connect() only
+        s->session = new BearSSL::Session();
+        s->ip = ip;
+        s->port = port;
+        s->auth = auth;
+        s->knownKey = knownKey;
+        return s->session;
+    }
+    #endif
+    #if MODBUSTLS_SERVER_SESSIONS > 0
+    BearSSL::ServerSessions* _serverSessions = nullptr;
+    #endif
+    #endif
+    // Connect with CA certificate (nullptr - don't verify server) or, if knownKey is set, with server public key
+    bool _connect(IPAddress ip, uint16_t port, const char* client_cert, const char* client_private_key, const char* ca_cert, const char* key = nullptr, bool knownKey = false) {
+	    int16_t p = addClient(ip, false);
 	    if (p < 0)
-		    return p;
-	    tcpclient[p] = new WiFiClientSecure();
-        BIT_CLEAR(tcpServerConnection, p);
-        #if defined(ESP8266)
-        BearSSL::X509List *clientCertList = new BearSSL::X509List(client_cert);
-        BearSSL::PrivateKey *clientPrivKey = new BearSSL::PrivateKey(client_private_key);
-        tcpclient[p]->setClientRSACert(clientCertList, clientPrivKey);
-        tcpclient[p]->setBufferSizes(512, 512);
+		    return false;
+        *conn[p].client = WiFiClientSecure();  // Object of previous connection keeps its settings, e.g. insecure mode
+        #if defined(MODBUSTLS_BEARSSL)
+        BearSSL::X509List* cert;
+        BearSSL::PrivateKey* privateKey;
+        BearSSL::X509List* ca;
+        BearSSL::PublicKey* publicKey;
+        if (!use(p, client_cert, client_private_key, ca_cert, key)
+            || !credential(_certs, client_cert, cert) || !credential(_keys, client_private_key, privateKey)
+            || !credential(_certs, ca_cert, ca) || !credential(_publicKeys, key, publicKey)) {
+            dropClient(p);
+            return false;
+        }
+        conn[p].client->setClientRSACert(cert, privateKey);
+        conn[p].client->setBufferSizes(512, 512);
+        #if MODBUSTLS_SESSIONS > 0
+        conn[p].client->setSession(session(ip, port, knownKey ? key : ca_cert, knownKey));
+        #endif
+        if (knownKey)
+            conn[p].client->setKnownKey(publicKey);
+        else if (ca)
+            conn[p].client->setTrustAnchors(ca);
+        else
+            conn[p].client->setInsecure();
         #else
-        tcpclient[p]->setCertificate(client_cert);
-        tcpclient[p]->setPrivateKey(client_private_key);
+        conn[p].client->setCertificate(client_cert);
+        conn[p].client->setPrivateKey(client_private_key);
+        if (ca_cert)
+            conn[p].client->setCACert(ca_cert);
         #endif
-        return p;
+        if (!conn[p].client->connect(ip, port)) {
+            dropClient(p);  // Free slot for next attempt
+            return false;
+        }
+        connOpened(p);
+        return true;
     }
 #if defined(MODBUSIP_USE_DNS)
     static IPAddress resolver (const char* host) {
@@ -59,17 +196,46 @@ class ModbusTLS : public ModbusAPI<ModbusTCPTemplate<WiFiServerSecure, WiFiClien
         resolve = resolver;
 #endif
     }
-    #if defined(ESP8266)
+    #if defined(MODBUSTLS_BEARSSL)
+    ~ModbusTLS() {
+        for (int16_t i = 0; i < connCount; i++)    // Drop connections before credentials they are using
+            if (conn[i].client)
+                dropClient(i);
+        delete tcpserver;
+        tcpserver = nullptr;
+        freeCredentials(_certs);
+        freeCredentials(_keys);
+        freeCredentials(_publicKeys);
+        free(_uses);
+        #if MODBUSTLS_SESSIONS > 0
+        for (uint8_t i = 0; i < MODBUSTLS_SESSIONS; i++)
+            delete _sessions[i].session;
+        #endif
+        #if MODBUSTLS_SERVER_SESSIONS > 0
+        delete _serverSessions;
+        #endif
+    }
+
 	void server(uint16_t port, const char* server_cert = nullptr, const char* server_private_key = nullptr, const char* ca_cert = nullptr) {
         serverPort = port;
 	    tcpserver = new WiFiServerSecure(serverPort);
-        BearSSL::X509List *serverCertList = new BearSSL::X509List(server_cert);
-        BearSSL::PrivateKey *serverPrivKey = new BearSSL::PrivateKey(server_private_key);
-        tcpserver->setRSACert(serverCertList, serverPrivKey);
-        if (ca_cert) {
-            BearSSL::X509List *trustedCA = new BearSSL::X509List(ca_cert);
-            tcpserver->setClientTrustAnchor(trustedCA);
-        }
+        _serverPem[0] = server_cert;	// Kept in cache while server is running
+        _serverPem[1] = server_private_key;
+        _serverPem[2] = ca_cert;
+        BearSSL::X509List* cert;
+        BearSSL::PrivateKey* privateKey;
+        BearSSL::X509List* ca;
+        credential(_certs, server_cert, cert);
+        credential(_keys, server_private_key, privateKey);
+        credential(_certs, ca_cert, ca);
+        tcpserver->setRSACert(cert, privateKey);
+        if (ca)
+            tcpserver->setClientTrustAnchor(ca);
+        #if MODBUSTLS_SERVER_SESSIONS > 0
+        if (!_serverSessions)
+            _serverSessions = new BearSSL::ServerSessions(MODBUSTLS_SERVER_SESSIONS);
+        tcpserver->setCache(_serverSessions);
+        #endif
         //tcpserver->setBufferSizes(512, 512);
 	    tcpserver->begin();
     }
@@ -77,10 +243,7 @@ class ModbusTLS : public ModbusAPI<ModbusTCPTemplate<WiFiServerSecure, WiFiClien
     bool connectWithKnownKey(IPAddress ip, uint16_t port, const char* client_cert = nullptr, const char* client_private_key = nullptr, const char* key = nullptr) {
         if(getSlave(ip) >= 0)
 		    return true;
-        int8_t p = _connect(ip, port, client_cert, client_private_key);
-        BearSSL::PublicKey *clientPublicKey = new BearSSL::PublicKey(key);
-        tcpclient[p]->setKnownKey(clientPublicKey);
-        return tcpclient[p]->connect(ip, port);
+        return _connect(ip, port, client_cert, client_private_key, nullptr, key, true);
     }
 
     #endif
@@ -97,24 +260,6 @@ class ModbusTLS : public ModbusAPI<ModbusTCPTemplate<WiFiServerSecure, WiFiClien
             return false;
         if(getSlave(ip) >= 0)
 		    return false;
-        int8_t p = _connect(ip, port, client_cert, client_private_key);
-        if (p < 0)
-            return false;
-        #if defined(ESP8266)
-        if (ca_cert) {
-            BearSSL::X509List *trustedCA = new BearSSL::X509List(ca_cert);
-            tcpclient[p]->setTrustAnchors(trustedCA);
-        } else {
-            tcpclient[p]->setInsecure();
-        }
-        #else
-        if (ca_cert) {
-            tcpclient[p]->setCACert(ca_cert);
-        }
-        #endif
-        //return tcpclient[p]->connect(ip, port);
-        if (!tcpclient[p]->connect(ip, port))
-            return false;
-        return true;
+        return _connect(ip, port, client_cert, client_private_key, ca_cert);
     }
 };
@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include <ModbusFileStore.h>
 
 #define FILE_LEN 100
 uint8_t block[FILE_LEN*2];
@@ -59,4 +60,42 @@ void testFile() {
       Serial.println("FAILED");
     }
   }
-}
\ No newline at end of file
+}
+
+ModbusFileStore store;
+const uint8_t storeRom[] = "Read-only file records";
+uint8_t storeRam[FILE_LEN * 2];
+
+void testFileStore() {
+  store.map(1, storeRom, sizeof(storeRom));
+  store.map(2, storeRam, sizeof(storeRam));
+  slave.onFile(store.handler());
+
+  Serial.print("FILE STORE READ:");
+  memset(block, 0, FILE_LEN * 2);
+  master.readFileRec(1, 1, 2, 4, block, cbWrite);
+  if (wait() == Modbus::EX_SUCCESS && memcmp(block, storeRom + 4, 8) == 0) {
+    Serial.println(" PASSED");
+  } else {
+    Serial.println(" FAILED");
+  }
+
+  Serial.print("FILE STORE WRITE:");
+  for (uint8_t i = 0; i < FILE_LEN * 2; i++)
+    block[i] = i;
+  master.writeFileRec(1, 2, 0, FILE_LEN, block, cbWrite);
+  if (wait() == Modbus::EX_SUCCESS && memcmp(block, storeRam, FILE_LEN * 2) == 0) {
+    Serial.println(" PASSED");
+  } else {
+    Serial.println(" FAILED");
+  }
+
+  Serial.print("FILE STORE READ-ONLY:");
+  master.writeFileRec(1, 1, 0, 1, block, cbWrite);
+  if (wait() == Modbus::EX_ILLEGAL_ADDRESS) {
+    Serial.println(" PASSED");
+  } else {
+    Serial.println(" FAILED");
+  }
+  slave.onFile(handleFile);
+}
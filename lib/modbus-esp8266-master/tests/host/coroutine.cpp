@@ -0,0 +1,133 @@
+/*
+    Modbus Library for ESP8266/ESP32
+    ModbusFuture coroutine test for native host build
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+
+// Coroutines co_await reads and writes to loopback ModbusTCP server served by the same loop. Two of them run
+// interleaved with requests in progress at once, others check exception result together with then() continuation
+// and request failed to send which must not suspend. Exit code is non-zero if any check fails. Needs C++20.
+// Build and run from the repository root:
+//   g++ -std=gnu++20 -D ARDUINO_ARCH_HOST -I lib/ArduinoHost/src -I lib/modbus-esp8266-master/src
+//     lib/ArduinoHost/src/*.cpp lib/modbus-esp8266-master/src/*.cpp lib/modbus-esp8266-master/tests/host/coroutine.cpp
+//     -o coroutine && ./coroutine
+
+#include <Arduino.h>
+#include <ModbusTCP.h>
+
+#if !defined(MODBUS_COROUTINES)
+#error "Coroutines are not available, build with -std=gnu++20"
+#endif
+
+#define PORT 15022
+#define RD_REGS 10	// Read-only Hregs 0.., value is address * 3
+#define WR_REG 20	// Write/read-back Hreg owned by each worker 20..
+#define ITERATIONS 100
+
+ModbusTCP server;
+ModbusTCP client;
+IPAddress loopback(127, 0, 0, 1);
+IPAddress absent(127, 0, 0, 2);	// Never connected
+bool passed = true;
+uint8_t running = 0;
+uint8_t inFlight = 0;
+uint8_t maxInFlight = 0;
+
+void check(const char* name, bool condition) {
+	Serial.printf("%s: %s\n", name, condition ? "PASSED" : "FAILED");
+	passed = passed && condition;
+}
+
+ModbusCoroutine sequence() {
+	running++;
+	uint16_t v[4];
+	uint16_t sum = 0;
+	bool ok = co_await client.readAsync(loopback, HREG(0), v, 4) == Modbus::EX_SUCCESS;
+	for (uint8_t i = 0; i < 4; i++) {
+		ok = ok && v[i] == i * 3;
+		sum += v[i];
+	}
+	ok = ok && co_await client.writeAsync(loopback, HREG(WR_REG), sum) == Modbus::EX_SUCCESS;
+	uint16_t r = 0;
+	ok = ok && co_await client.readAsync(loopback, HREG(WR_REG), &r) == Modbus::EX_SUCCESS && r == sum;
+	check("Read, write and read back in sequence", ok);
+	running--;
+}
+
+ModbusCoroutine worker(uint8_t k, uint16_t* good) {
+	running++;
+	uint16_t reg = WR_REG + 1 + k;
+	for (uint16_t i = 0; i < ITERATIONS; i++) {
+		uint16_t w = k * 1000 + i;
+		uint16_t r = 0;
+		ModbusFuture f = client.writeAsync(loopback, HREG(reg), w);
+		if (++inFlight > maxInFlight)	// Requests awaited at once by all workers
+			maxInFlight = inFlight;
+		Modbus::ResultCode result = co_await f;
+		inFlight--;
+		if (result == Modbus::EX_SUCCESS && co_await client.readAsync(loopback, HREG(reg), &r) == Modbus::EX_SUCCESS && r == w)
+			(*good)++;
+	}
+	running--;
+}
+
+ModbusCoroutine exception() {
+	running++;
+	uint16_t v;
+	Modbus::ResultCode then = Modbus::EX_SUCCESS;
+	Modbus::ResultCode r = co_await client.readAsync(loopback, HREG(100), &v).then([&then](Modbus::ResultCode result) {
+		then = result;
+	});
+	check("Exception is returned", r == Modbus::EX_ILLEGAL_ADDRESS);
+	check("Continuation set by then() runs before coroutine is resumed", then == Modbus::EX_ILLEGAL_ADDRESS);
+	running--;
+}
+
+ModbusCoroutine notSent(bool* resumed) {
+	uint16_t v;
+	ModbusFuture f = client.readAsync(absent, HREG(0), &v);
+	Modbus::ResultCode r = co_await f;
+	*resumed = true;
+	check("Request failed to send doesn't suspend", !f.valid() && r == Modbus::EX_GENERAL_FAILURE);
+}
+
+bool serve(uint32_t timeout = 5000) {
+	uint32_t start = millis();
+	while (running && millis() - start < timeout) {
+		server.task();
+		client.task();
+		delay(0);
+	}
+	return !running;
+}
+
+void setup() {
+	Serial.begin(115200);
+	Serial.println("ModbusFuture coroutine test");
+	server.server(PORT);
+	for (uint16_t i = 0; i < RD_REGS; i++)
+		server.addHreg(i, i * 3);
+	server.addHreg(WR_REG, 0, 3);
+	client.client();
+	if (!client.connect(loopback, PORT)) {
+		Serial.println("Connect failed");
+		exit(1);
+	}
+	sequence();
+	check("Sequence completed", serve());
+	uint16_t good[2] = {0, 0};
+	worker(0, &good[0]);
+	worker(1, &good[1]);
+	check("Interleaved coroutines completed", serve());
+	check("Interleaved coroutines results", good[0] == ITERATIONS && good[1] == ITERATIONS);
+	check("Interleaved coroutines had requests in progress at once", maxInFlight == 2);
+	exception();
+	check("Exception completed", serve());
+	bool resumed = false;
+	notSent(&resumed);
+	check("Request failed to send completed at once", resumed);
+	Serial.println(passed ? "PASSED" : "FAILED");
+	exit(passed ? 0 : 1);
+}
+
+void loop() {}
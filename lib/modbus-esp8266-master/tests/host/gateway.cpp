@@ -0,0 +1,266 @@
+/*
+    Modbus Library for ESP8266/ESP32
+    ModbusGateway test for native host build
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+
+// ModbusTCP client sends requests through ModbusGateway to ModbusRTU slave connected by pseudo terminal pair,
+// all served by single loop. Checks coalescing of overlapping and adjacent reads, slicing of coils at non-byte
+// offsets, retry of each client after exception to merged range, cache hit and expiry, cache invalidation by
+// writes and ordering of reads against queued broadcast write. Exit code is non-zero if any check fails.
+// Build and run from the repository root:
+//   g++ -std=gnu++17 -D ARDUINO_ARCH_HOST -I lib/ArduinoHost/src -I lib/modbus-esp8266-master/src
+//     lib/ArduinoHost/src/*.cpp lib/modbus-esp8266-master/src/*.cpp lib/modbus-esp8266-master/tests/host/gateway.cpp
+//     -o gateway && ./gateway
+
+#include <Arduino.h>
+#include <ModbusTCP.h>
+#include <ModbusRTU.h>
+#include <ModbusGateway.h>
+
+#define PORT 15021
+#define SLAVE_ID 1
+#define HREGS 50	// Slave Hregs 0.., value is address * 3
+#define COILS 40	// Slave coils 0.., set if address % 3 == 0
+#define BLOCKER 49	// Hreg read first to keep the bus busy while next requests are queued
+
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+ModbusTCP tcp;
+ModbusRTU rtu;
+ModbusRTU slave;
+ModbusGateway<ModbusTCP> gw(tcp);
+ModbusTCP client;
+IPAddress loopback(127, 0, 0, 1);
+bool passed = true;
+
+struct TResult {
+	bool done = false;
+	Modbus::ResultCode code = Modbus::EX_GENERAL_FAILURE;
+};
+TResult results[4];
+
+cbTransaction result(uint8_t i) {
+	results[i] = TResult();
+	return [i](Modbus::ResultCode event, uint16_t, void*) {
+		results[i].code = event;
+		results[i].done = true;
+		return true;
+	};
+}
+
+bool wait(uint8_t count, uint32_t timeout = 2000) {
+	uint32_t start = millis();
+	while (millis() - start < timeout) {
+		gw.task();
+		slave.task();
+		client.task();
+		bool done = true;
+		for (uint8_t i = 0; i < count; i++)
+			done = done && results[i].done;
+		if (done)
+			return true;
+		delay(0);
+	}
+	return false;
+}
+
+void idle(uint32_t ms) {
+	uint32_t start = millis();
+	while (millis() - start < ms) {
+		gw.task();
+		slave.task();
+		client.task();
+		delay(0);
+	}
+}
+
+void check(const char* name, bool condition) {
+	Serial.printf("%s: %s\n", name, condition ? "PASSED" : "FAILED");
+	passed = passed && condition;
+}
+
+bool hregs(const uint16_t* v, uint16_t address, uint16_t count) {
+	for (uint16_t i = 0; i < count; i++)
+		if (v[i] != slave.Hreg(address + i))
+			return false;
+	return true;
+}
+
+bool coils(const bool* v, uint16_t address, uint16_t count) {
+	for (uint16_t i = 0; i < count; i++)
+		if (v[i] != slave.Coil(address + i))
+			return false;
+	return true;
+}
+
+// Slave checks only first register of read range, device checking whole range is needed to raise exception to
+// merged read while one of clients requests valid registers
+Modbus::ResultCode strict(Modbus::FunctionCode fc, const Modbus::RequestData data) {
+	if (fc == Modbus::FC_READ_REGS && data.reg.address + data.regCount > HREGS)
+		return Modbus::EX_ILLEGAL_ADDRESS;
+	return Modbus::EX_SUCCESS;
+}
+
+uint16_t blocker;
+
+void block() {
+	client.readHreg(loopback, BLOCKER, &blocker, 1, result(0), SLAVE_ID);
+}
+
+void testCoalesce() {
+	uint16_t a[10], b[10], c[5];
+	Modbus::ResultCode ok = Modbus::EX_SUCCESS;
+	gw.coalesce(true);
+	auto s = gw.stats();
+	block();
+	client.readHreg(loopback, 0, a, 10, result(1), SLAVE_ID);
+	client.readHreg(loopback, 5, b, 10, result(2), SLAVE_ID);	// Overlapping
+	client.readHreg(loopback, 15, c, 5, result(3), SLAVE_ID);	// Adjacent
+	bool done = wait(4);
+	check("Overlapping and adjacent reads", done && results[1].code == ok && results[2].code == ok && results[3].code == ok
+		&& hregs(a, 0, 10) && hregs(b, 5, 10) && hregs(c, 15, 5));
+	check("Overlapping and adjacent reads are sent once", gw.stats().forwarded - s.forwarded == 2
+		&& gw.stats().coalesced - s.coalesced == 2);
+}
+
+void testCoils() {
+	bool a[10], b[21], c[3];
+	Modbus::ResultCode ok = Modbus::EX_SUCCESS;
+	auto s = gw.stats();
+	block();
+	client.readCoil(loopback, 3, a, 10, result(1), SLAVE_ID);	// 3..12
+	client.readCoil(loopback, 7, b, 21, result(2), SLAVE_ID);	// 7..27, offset 4 in merged range
+	client.readCoil(loopback, 9, c, 3, result(3), SLAVE_ID);	// Contained, offset 6
+	bool done = wait(4);
+	check("Coils sliced at non-byte offsets", done && results[1].code == ok && results[2].code == ok && results[3].code == ok
+		&& coils(a, 3, 10) && coils(b, 7, 21) && coils(c, 9, 3));
+	check("Coil reads are sent once", gw.stats().forwarded - s.forwarded == 2 && gw.stats().coalesced - s.coalesced == 2);
+}
+
+void testRetry() {
+	uint16_t a[4], b[6];
+	block();
+	client.readHreg(loopback, HREGS - 4, a, 4, result(1), SLAVE_ID);	// Valid
+	client.readHreg(loopback, HREGS - 2, b, 6, result(2), SLAVE_ID);	// Past the last Hreg
+	bool done = wait(3);
+	check("Each client is retried after exception to merged range", done && results[1].code == Modbus::EX_SUCCESS
+		&& hregs(a, HREGS - 4, 4) && results[2].code == Modbus::EX_ILLEGAL_ADDRESS);
+}
+
+void testCache() {
+	uint16_t a[10], b[4];
+	gw.cacheTtl(200);
+	auto s = gw.stats();
+	client.readHreg(loopback, 0, a, 10, result(0), SLAVE_ID);
+	bool done = wait(1);
+	slave.Hreg(3, 999);	// Changed by slave itself, seen after TTL
+	client.readHreg(loopback, 2, b, 4, result(1), SLAVE_ID);	// Narrower range
+	done = done && wait(2);
+	check("Cache hit", done && results[1].code == Modbus::EX_SUCCESS && b[1] == 9 && b[0] == 6
+		&& gw.stats().forwarded - s.forwarded == 1 && gw.stats().cached - s.cached == 1);
+	idle(250);
+	client.readHreg(loopback, 2, b, 4, result(2), SLAVE_ID);
+	done = wait(3);
+	check("Cache expiry", done && results[2].code == Modbus::EX_SUCCESS && hregs(b, 2, 4)
+		&& gw.stats().forwarded - s.forwarded == 2);
+	slave.Hreg(3, 9);
+}
+
+// Read the range to cache, write through gateway, read again. Read must go to the bus and see written value
+void invalidate(const char* name, TAddress reg, uint16_t count, std::function<uint16_t(cbTransaction)> write) {
+	uint16_t v[16];
+	bool b[16];
+	Modbus::ResultCode ok = Modbus::EX_SUCCESS;
+	auto read = [&](cbTransaction cb) {
+		return reg.type == TAddress::COIL ? client.readCoil(loopback, reg.address, b, count, cb, SLAVE_ID)
+			: client.readHreg(loopback, reg.address, v, count, cb, SLAVE_ID);
+	};
+	read(result(0));
+	bool done = wait(1);
+	auto s = gw.stats();
+	write(result(1));
+	done = done && wait(2);
+	read(result(2));
+	done = done && wait(3);
+	bool match = reg.type == TAddress::COIL ? coils(b, reg.address, count) : hregs(v, reg.address, count);
+	check(name, done && results[0].code == ok && results[1].code == ok && results[2].code == ok && match
+		&& gw.stats().cached == s.cached);
+}
+
+void testInvalidation() {
+	static bool coilValues[4] = { true, true, false, false };
+	static uint16_t regValues[3] = { 100, 101, 102 };
+	static uint16_t readBack[2];
+	gw.cacheTtl(5000);
+	invalidate("Cache dropped by FC05", COIL(0), 16, [](cbTransaction cb) {
+		return client.writeCoil(loopback, 1, true, cb, SLAVE_ID);
+	});
+	invalidate("Cache dropped by FC0F", COIL(0), 16, [](cbTransaction cb) {
+		return client.writeCoil(loopback, 4, coilValues, 4, cb, SLAVE_ID);
+	});
+	invalidate("Cache dropped by FC06", HREG(0), 10, [](cbTransaction cb) {
+		return client.writeHreg(loopback, 2, 200, cb, SLAVE_ID);
+	});
+	invalidate("Cache dropped by FC10", HREG(0), 10, [](cbTransaction cb) {
+		return client.writeHreg(loopback, 4, regValues, 3, cb, SLAVE_ID);
+	});
+	invalidate("Cache dropped by FC16", HREG(0), 10, [](cbTransaction cb) {
+		return client.maskHreg(loopback, 6, 0x00F0, 0x0005, cb, SLAVE_ID);
+	});
+	invalidate("Cache dropped by FC17", HREG(0), 10, [](cbTransaction cb) {
+		return client.readWriteHreg(loopback, 20, readBack, 2, 8, regValues, 2, cb, SLAVE_ID);
+	});
+	gw.cacheTtl(0);
+	gw.cacheClear();
+}
+
+void testBroadcast() {
+	uint16_t a[5], b[5];
+	slave.Hreg(2, 6);
+	block();
+	client.readHreg(loopback, 0, a, 5, result(1), SLAVE_ID);
+	client.writeHreg(loopback, 2, 777, result(2), MODBUSRTU_BROADCAST);
+	client.readHreg(loopback, 0, b, 5, result(3), SLAVE_ID);	// Must not be merged into read before the write
+	bool done = wait(4);
+	check("Read is not merged past broadcast write", done && results[1].code == Modbus::EX_SUCCESS && a[2] == 6
+		&& results[2].code == Modbus::EX_SUCCESS && results[3].code == Modbus::EX_SUCCESS && b[2] == 777);
+}
+
+void setup() {
+	Serial.begin(115200);
+	Serial.println("ModbusGateway test");
+	Serial1.begin(115200);
+	setenv("HOST_SERIAL2", Serial1.portName(), 1);
+	Serial2.begin(115200);
+	rtu.begin(&Serial1);
+	rtu.setBaudrate(115200);
+	rtu.master();
+	slave.begin(&Serial2);
+	slave.setBaudrate(115200);
+	slave.slave(SLAVE_ID);
+	slave.onRequest(strict);
+	slave.addHreg(0, 0, HREGS);
+	for (uint16_t i = 0; i < HREGS; i++)
+		slave.Hreg(i, i * 3);
+	slave.addCoil(0, false, COILS);
+	for (uint16_t i = 0; i < COILS; i++)
+		slave.Coil(i, i % 3 == 0);
+	tcp.server(PORT);
+	gw.addBus(rtu, SLAVE_ID, SLAVE_ID);
+	client.client();
+	if (!client.connect(loopback, PORT)) {
+		Serial.println("Connect failed");
+		exit(1);
+	}
+	testCoalesce();
+	testCoils();
+	testRetry();
+	testCache();
+	testInvalidation();
+	testBroadcast();
+	Serial.println(passed ? "PASSED" : "FAILED");
+	exit(passed ? 0 : 1);
+}
+
+void loop() {}
@@ -0,0 +1,111 @@
+/*
+    Modbus Library for ESP8266/ESP32
+    ModbusRequestQueue stress test for native host build
+	https://github.com/emelianov/modbus-esp8266
+	This code is licensed under the BSD New License. See LICENSE.txt for more info.
+*/
+
+// Threads mix blocking read()/write() and submit() through single queue to loopback ModbusTCP server
+// served by main thread. Run with window 1 and 4, exit code is non-zero if any result is failed or wrong.
+// Build and run from the repository root:
+//   g++ -std=gnu++17 -D ARDUINO_ARCH_HOST -I lib/ArduinoHost/src -I lib/modbus-esp8266-master/src
+//     lib/ArduinoHost/src/*.cpp lib/modbus-esp8266-master/src/*.cpp lib/modbus-esp8266-master/tests/host/queue.cpp
+//     -lpthread -o queue && ./queue
+
+#include <Arduino.h>
+#include <ModbusTCP.h>
+#include <ModbusRequestQueue.h>
+#include <atomic>
+#include <vector>
+
+#define PORT 15020
+#define THREADS 8
+#define ITERATIONS 500
+#define RD_REGS 100	// Read-only Hregs 0.., value is address * 3
+#define WR_REG 200	// Write/read-back Hreg owned by each thread 200..
+
+ModbusTCP server;
+IPAddress loopback(127, 0, 0, 1);
+bool passed = true;
+
+bool run(uint16_t window) {
+	std::atomic<bool> stop{false};
+	std::atomic<int> finished{0}, ok{0}, bad{0}, failed{0};
+	ModbusTCP mb;
+	mb.client();
+	if (!mb.connect(loopback, PORT)) {
+		Serial.println("Connect failed");
+		return false;
+	}
+	ModbusRequestQueue<ModbusTCP> queue(mb, window, THREADS);
+	std::thread owner([&] { while (!stop) queue.task(5); });
+	std::vector<std::thread> threads;
+	for (int k = 0; k < THREADS; k++) threads.emplace_back([&, k] {
+		for (int i = 0; i < ITERATIONS; i++) {
+			if (i % 4 == 3) {
+				uint16_t v[5];
+				uint16_t a = (i * 13 + k) % (RD_REGS - 5);
+				if (queue.read(loopback, HREG(a), v, 5) != Modbus::EX_SUCCESS) {
+					failed++;
+					continue;
+				}
+				bool match = true;
+				for (uint8_t j = 0; j < 5; j++)
+					if (v[j] != (a + j) * 3)
+						match = false;
+				match ? ok++ : bad++;
+			} else if (i % 4 == 1) {
+				std::atomic<bool> done{false};
+				uint16_t a = (i + k) % RD_REGS;
+				uint16_t v = 0;
+				while (!queue.submit([&](ModbusTCP& m, cbTransaction cb) { return m.readHreg(loopback, a, &v, 1, cb); },
+						[&](Modbus::ResultCode r) {
+							if (r != Modbus::EX_SUCCESS)
+								failed++;
+							else
+								v == a * 3 ? ok++ : bad++;
+							done = true;
+						}))
+					std::this_thread::yield();	// Queue is full
+				while (!done)
+					std::this_thread::yield();
+			} else {
+				uint16_t reg = WR_REG + k;
+				uint16_t w = k * 1000 + i;
+				uint16_t v = 0;
+				if (queue.write(loopback, HREG(reg), w) != Modbus::EX_SUCCESS
+					|| queue.read(loopback, HREG(reg), &v) != Modbus::EX_SUCCESS) {
+					failed++;
+					continue;
+				}
+				v == w ? ok++ : bad++;
+			}
+		}
+		finished++;
+	});
+	while (finished < THREADS) {	// Server is served by this thread only
+		server.task();
+		delay(0);
+	}
+	for (auto& t : threads)
+		t.join();
+	stop = true;
+	owner.join();
+	Serial.printf("window %d: %d ok, %d bad, %d failed\n", window, (int)ok, (int)bad, (int)failed);
+	return !bad && !failed && ok == THREADS * ITERATIONS;
+}
+
+void setup() {
+	Serial.begin(115200);
+	Serial.println("ModbusRequestQueue test");
+	server.server(PORT);
+	for (uint16_t i = 0; i < RD_REGS; i++)
+		server.addHreg(i, i * 3);
+	server.addHreg(WR_REG, 0, THREADS);
+	passed = run(1) && passed;
+	passed = run(4) && passed;
+	Serial.println(passed ? "PASSED" : "FAILED");
+	exit(passed ? 0 : 1);
+}
+
+void loop() {}
@@ -133,6 +133,7 @@ readMultiple(SLAVE_ID, ISTS(HREG_ID), 10);
   {
     initFile();
     testFile();
+    testFileStore();
   }
 }
 void loop() {
@@ -3,8 +3,10 @@
   - TFT_eSPI (ILI9341 240x320)
   - Rotary encoder + 2 buttons (Select, Back)
   - RS-485 (UART1) Modbus RTU Slave
+  - Optional Modbus RTU over TCP on WiFi (see simulator.h)
   - Parameters mirrored in Holding Registers with correct resolution step
   - Serial config menu (baud, parity, data bits, stop bits)
+  - Modbus turnaround and framing error statistics screen (long-press Back on Home)
 
   Libraries (Arduino Library Manager or matching your provided zip):
     - TFT_eSPI by Bodmer
@@ -18,13 +20,9 @@
 #include <TFT_eSPI.h>
 #include <Encoder.h>
 #include <Button2.h>
-#include <ModbusRTU.h>
+#include "simulator.h"
 
 // ---------------- Pin map (adjust if needed) ----------------
-static const int PIN_RS485_RX = 16;  // UART1 RX
-static const int PIN_RS485_TX = 17;  // UART1 TX
-static const int PIN_RS485_DERE = 4; // MAX485 DE/RE tied together
-
 static const int PIN_ENC_CLK = 33;
 static const int PIN_ENC_DT = 32;
 static const int PIN_BTN_SEL = 25;
@@ -38,10 +36,6 @@ Encoder enc(PIN_ENC_DT, PIN_ENC_CLK);
 Button2 btnSelect(PIN_BTN_SEL);
 Button2 btnBack(PIN_BTN_BACK);
 
-// ---------------- Modbus RTU ----------------
-HardwareSerial RS485(1);
-ModbusRTU mb;
-
 // ---------------- App state ----------------
 enum class Screen : uint8_t
 {
@@ -49,7 +43,8 @@ enum class Screen : uint8_t
   PARAM_LIST,
   PARAM_EDIT,
   SERIAL_MENU,
-  SERIAL_EDIT
+  SERIAL_EDIT,
+  STATS
 };
 
 Screen screen = Screen::HOME;
@@ -57,50 +52,6 @@ int listIndex = 0; // generic list cursor
 int editIndex = 0; // which item is being edited
 long encPrev = 0;
 
-// ---------------- Parameters & registers ----------------
-// Holding register mapping:
-// 1: pH       (0.01 step)
-// 2: TDS ppm  (1 step)
-// 3: TSS NTU  (1 step)  -- "Turbidity"
-// 4: COD mg/L (1 step)
-// 5: BOD mg/L (1 step)
-// 6: DO mg/L  (0.01 step)
-// 7: NH3-N mg/L (0.01 step)
-
-struct Param
-{
-  const char *name;
-  const char *unit;
-  float minVal;
-  float maxVal;
-  float step;   // UI increment, also scaling for Hreg
-  uint16_t reg; // Hreg address (1..)
-  float value;  // actual (float)
-};
-
-Param params[] = {
-    {"pH", "pH", 0.00f, 14.00f, 0.01f, 1, 7.00f},
-    {"TDS", "ppm", 0.0f, 1008.0f, 1.0f, 2, 500.0f},
-    {"TSS", "NTU", 0.0f, 1000.0f, 1.0f, 3, 100.0f}, // Turbidity
-    {"COD", "mg/L", 0.0f, 1300.0f, 1.0f, 4, 200.0f},
-    {"BOD", "mg/L", 0.0f, 350.0f, 1.0f, 5, 50.0f},
-    {"DO", "mg/L", 0.00f, 20.00f, 0.01f, 6, 8.00f},
-    {"NH3-N", "mg/L", 0.00f, 1000.0f, 0.01f, 7, 5.00f}};
-static const int PARAM_COUNT = sizeof(params) / sizeof(params[0]);
-
-// ---------------- Serial configuration model ----------------
-struct SerialCfg
-{
-  uint32_t baud;
-  uint8_t dataBits; // 7 or 8
-  char parity;      // 'N','E','O'
-  uint8_t stopBits; // 1 or 2
-};
-
-SerialCfg scfg = {9600, 8, 'N', 1};
-const uint32_t BAUDS[] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
-const int BAUD_COUNT = sizeof(BAUDS) / sizeof(BAUDS[0]);
-
 // Which field is being edited in serial menu
 enum class SerialField : uint8_t
 {
@@ -112,9 +63,6 @@ enum class SerialField : uint8_t
 SerialField serialField = SerialField::BAUD;
 
 // ---------------- Utils ----------------
-template <typename T>
-T clamp(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
-
 String parityToString(char p)
 {
   switch (p)
@@ -128,53 +76,6 @@ String parityToString(char p)
   }
 }
 
-uint32_t parityToMode(char p, uint8_t databits, uint8_t stopbits)
-{
-  // Compose Arduino's SERIAL_* mode (e.g., SERIAL_8N1, SERIAL_8E1, etc.)
-  // For ESP32 core, supported macros: SERIAL_8N1, SERIAL_8E1, SERIAL_8O1, SERIAL_7N1, etc.
-  if (databits == 7)
-  {
-    if (p == 'E')
-      return (stopbits == 2) ? SERIAL_7E2 : SERIAL_7E1;
-    if (p == 'O')
-      return (stopbits == 2) ? SERIAL_7O2 : SERIAL_7O1;
-    return (stopbits == 2) ? SERIAL_7N2 : SERIAL_7N1;
-  }
-  else
-  { // 8
-    if (p == 'E')
-      return (stopbits == 2) ? SERIAL_8E2 : SERIAL_8E1;
-    if (p == 'O')
-      return (stopbits == 2) ? SERIAL_8O2 : SERIAL_8O1;
-    return (stopbits == 2) ? SERIAL_8N2 : SERIAL_8N1;
-  }
-}
-
-void rs485Reinit()
-{
-  RS485.end();
-  delay(20);
-  RS485.begin(scfg.baud, parityToMode(scfg.parity, scfg.dataBits, scfg.stopBits),
-              PIN_RS485_RX, PIN_RS485_TX);
-  // With ModbusRTU (emelianov), begin can take driver (DE/RE) pin:
-  mb.begin(&RS485, PIN_RS485_DERE); // auto driver control
-  mb.slave(1);                      // Slave ID
-}
-
-// Scale float to 16-bit register using the defined step
-uint16_t toReg(const Param &p)
-{
-  // round to nearest step then cast
-  float scaled = p.value / p.step;
-  if (scaled < 0)
-    scaled = 0; // guard
-  return (uint16_t)lroundf(scaled);
-}
-float fromReg(const Param &p, uint16_t regval)
-{
-  return (float)regval * p.step;
-}
-
 // ---------------- Drawing ----------------
 void drawHeader(const char *title)
 {
@@ -297,6 +198,45 @@ void drawSerialEdit()
   tft.drawString("Rotate=Change  Sel=Apply  Back=Cancel", 10, tft.height() - 20, 2);
 }
 
+void drawStats()
+{
+  tft.fillScreen(TFT_BLACK);
+  drawHeader("Modbus Diagnostics (uS)");
+  tft.setTextColor(TFT_WHITE, TFT_BLACK);
+  char line[64];
+  snprintf(line, sizeof(line), "Requests %u  Min %u  Mean %u  Max %u",
+           diagReg(0), diagReg(4), diagReg(6), diagReg(5));
+  tft.drawString(line, 10, 32, 2);
+  snprintf(line, sizeof(line), "p50 %u  p90 %u  p99 %u", diagReg(7), diagReg(8), diagReg(9));
+  tft.drawString(line, 10, 54, 2);
+  snprintf(line, sizeof(line), "Last: total %u  proc %u  tx %u", diagReg(1), diagReg(2), diagReg(3));
+  tft.drawString(line, 10, 76, 2);
+  // Receive framing errors
+  tft.setTextColor(TFT_ORANGE, TFT_BLACK);
+  snprintf(line, sizeof(line), "Frames %u  CRC %u  t1.5 %u  Ovr %u  Short %u",
+           diagReg(10), diagReg(11), diagReg(12), diagReg(13), diagReg(14));
+  tft.drawString(line, 10, 98, 2);
+  snprintf(line, sizeof(line), "Split %u  Max gap %u  T3.5 %u", diagReg(15), diagReg(16), diagReg(17));
+  tft.drawString(line, 10, 120, 2);
+#if defined(MODBUSRTU_STATS)
+  // Per function code breakdown
+  tft.setTextColor(TFT_GREEN, TFT_BLACK);
+  int y = 148;
+  for (uint16_t fc = 1; fc < 0x80 && y < tft.height() - 40; fc++)
+  {
+    TRTULatency *l = mb.latency(fc);
+    if (!l)
+      continue;
+    snprintf(line, sizeof(line), "FC%02u  n %lu  mean %lu  p90 %lu  max %lu", fc, (unsigned long)l->count,
+             (unsigned long)(l->sum / l->count), (unsigned long)mb.latencyPercentile(90, fc), (unsigned long)l->max);
+    tft.drawString(line, 10, y, 2);
+    y += 20;
+  }
+#endif
+  tft.setTextColor(TFT_LIGHTGREY, TFT_BLACK);
+  tft.drawString("Back=Home", 10, tft.height() - 20, 2);
+}
+
 // ---------------- Input handlers ----------------
 void onSelect(Button2 &)
 {
@@ -333,6 +273,8 @@ void onSelect(Button2 &)
     screen = Screen::SERIAL_MENU;
     drawSerialMenu();
     break;
+  case Screen::STATS:
+    break;
   }
 }
 
@@ -360,6 +302,10 @@ void onBack(Button2 &)
     screen = Screen::SERIAL_MENU;
     drawSerialMenu();
     break;
+  case Screen::STATS:
+    screen = Screen::HOME;
+    drawHome();
+    break;
   }
 }
 
@@ -375,6 +321,16 @@ void onSelectLong(Button2 &)
   }
 }
 
+// Long-press Back from HOME opens turnaround statistics
+void onBackLong(Button2 &)
+{
+  if (screen == Screen::HOME)
+  {
+    screen = Screen::STATS;
+    drawStats();
+  }
+}
+
 // ---------------- Setup & Loop ----------------
 void setup()
 {
@@ -388,7 +344,9 @@ void setup()
   btnSelect.setLongClickTime(600);
   btnSelect.setPressedHandler(onSelect);
   btnSelect.setLongClickDetectedHandler(onSelectLong);
+  btnBack.setLongClickTime(600);
   btnBack.setPressedHandler(onBack);
+  btnBack.setLongClickDetectedHandler(onBackLong);
 
   // TFT
   tft.init();
@@ -396,16 +354,8 @@ void setup()
   tft.fillScreen(TFT_BLACK);
   drawHome();
 
-  // RS-485 UART & Modbus
-  pinMode(PIN_RS485_DERE, OUTPUT);
-  digitalWrite(PIN_RS485_DERE, LOW); // receive by default
-  rs485Reinit();                     // starts RS485 and mb
-
-  // Create holding registers and preload values
-  for (int i = 0; i < PARAM_COUNT; i++)
-  {
-    mb.addHreg(params[i].reg, toReg(params[i]));
-  }
+  // RS-485 UART & Modbus, holding registers preloaded with parameter values
+  simulatorBegin();
 
   encPrev = enc.read();
 }
@@ -413,7 +363,7 @@ void setup()
 void loop()
 {
   // Modbus task (must be called often)
-  mb.task();
+  simulatorTask();
 
   // Let buttons process
   btnSelect.loop();
@@ -422,11 +372,8 @@ void loop()
   // If a Modbus master wrote new values, reflect into UI
   for (int i = 0; i < PARAM_COUNT; i++)
   {
-    uint16_t rv = mb.Hreg(params[i].reg);
-    float newVal = fromReg(params[i], rv);
-    if (fabsf(newVal - params[i].value) > (params[i].step * 0.5f))
+    if (paramFromReg(i))
     {
-      params[i].value = clamp(newVal, params[i].minVal, params[i].maxVal);
       if (screen == Screen::HOME)
         drawHome();
       else if (screen == Screen::PARAM_LIST)
@@ -486,6 +433,9 @@ void loop()
       break;
     }
 
+    case Screen::STATS:
+      break;
+
     case Screen::SERIAL_EDIT:
     {
       if (serialField == SerialField::BAUD)
@@ -526,16 +476,13 @@ void loop()
   }
 
   // Periodically keep Hregs synced with our internal values (when user edits)
-  static uint32_t tSync = 0;
-  if (millis() - tSync > 300)
+  syncRegs();
+
+  // Refresh statistics screen
+  static uint32_t tStats = 0;
+  if (screen == Screen::STATS && millis() - tStats > 1000)
   {
-    tSync = millis();
-    for (int i = 0; i < PARAM_COUNT; i++)
-    {
-      uint16_t cur = mb.Hreg(params[i].reg);
-      uint16_t need = toReg(params[i]);
-      if (cur != need)
-        mb.Hreg(params[i].reg, need);
-    }
+    tStats = millis();
+    drawStats();
   }
 }
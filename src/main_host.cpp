@@ -0,0 +1,63 @@
+/*
+  ESP32 Modbus Sensor Simulator - headless host build
+  - Runs parameter model and Modbus RTU slave natively on Linux (pio run -e native)
+  - RS-485 is a pseudo terminal by default, its name is printed on start.
+    Set HOST_SERIAL1=/dev/ttyUSB0 to use a real serial adapter instead.
+  - Same registers are served over Modbus TCP on port SIM_TCP_PORT (1502)
+  - Parameter changes written by a Modbus master are logged to stdout
+  - Loop sleeps until serial or TCP input arrives instead of spinning
+*/
+
+#include "simulator.h"
+#include <poll.h>
+
+#ifndef SIM_IDLE_WAIT_MS
+#define SIM_IDLE_WAIT_MS 100
+#endif
+
+static void printParam(const Param &p)
+{
+  int dp = (p.step < 0.1f) ? 2 : 0;
+  Serial.printf("%-6s : %.*f %s (Hreg %u)\n", p.name, dp, p.value, p.unit, p.reg);
+}
+
+// Block until RS-485 or Modbus TCP has input. Registers change only on Modbus writes in headless build,
+// so there is nothing to do meanwhile.
+static void waitEvents()
+{
+  if (RS485.available() || mbTcp.eventPending())
+    return; // RTU frame being received or TCP connections left to serve
+  struct pollfd fds[2] = {{RS485.fd(), POLLIN, 0}, {mbTcp.eventFd(), POLLIN, 0}};
+  poll(fds, 2, SIM_IDLE_WAIT_MS);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+
+  // RS-485 UART & Modbus, holding registers preloaded with parameter values
+  simulatorBegin();
+
+  Serial.printf("WQMS Modbus Sensor Simulator (host) on %s, %u %d%c%d, slave %u\n",
+                RS485.portName(), scfg.baud, scfg.dataBits, scfg.parity, scfg.stopBits, mb.slave());
+  Serial.printf("Modbus TCP on port %u\n", SIM_TCP_PORT);
+  for (int i = 0; i < PARAM_COUNT; i++)
+    printParam(params[i]);
+}
+
+void loop()
+{
+  // Modbus task (must be called often)
+  simulatorTask();
+
+  // If a Modbus master wrote new values, reflect into model
+  for (int i = 0; i < PARAM_COUNT; i++)
+  {
+    if (paramFromReg(i))
+      printParam(params[i]);
+  }
+
+  syncRegs();
+
+  waitEvents();
+}
@@ -0,0 +1,217 @@
+/*
+  ESP32 Modbus Sensor Simulator
+  Parameter model, serial configuration and Modbus register mapping.
+*/
+
+#include "simulator.h"
+
+// ---------------- Modbus RTU ----------------
+HardwareSerial RS485(1);
+ModbusRTU mb;
+#if defined(SIM_RTU_OVER_TCP)
+ModbusRTUTCP mbNet;
+#endif
+#if defined(SIM_MODBUS_TCP)
+ModbusTCP mbTcp;
+#endif
+
+// ---------------- Parameters & registers ----------------
+Param params[] = {
+    {"pH", "pH", 0.00f, 14.00f, 0.01f, 1, 7.00f},
+    {"TDS", "ppm", 0.0f, 1008.0f, 1.0f, 2, 500.0f},
+    {"TSS", "NTU", 0.0f, 1000.0f, 1.0f, 3, 100.0f}, // Turbidity
+    {"COD", "mg/L", 0.0f, 1300.0f, 1.0f, 4, 200.0f},
+    {"BOD", "mg/L", 0.0f, 350.0f, 1.0f, 5, 50.0f},
+    {"DO", "mg/L", 0.00f, 20.00f, 0.01f, 6, 8.00f},
+    {"NH3-N", "mg/L", 0.00f, 1000.0f, 0.01f, 7, 5.00f}};
+const int PARAM_COUNT = sizeof(params) / sizeof(params[0]);
+
+// ---------------- Serial configuration model ----------------
+SerialCfg scfg = {9600, 8, 'N', 1};
+const uint32_t BAUDS[] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+const int BAUD_COUNT = sizeof(BAUDS) / sizeof(BAUDS[0]);
+
+uint32_t parityToMode(char p, uint8_t databits, uint8_t stopbits)
+{
+  // Compose Arduino's SERIAL_* mode (e.g., SERIAL_8N1, SERIAL_8E1, etc.)
+  // For ESP32 core, supported macros: SERIAL_8N1, SERIAL_8E1, SERIAL_8O1, SERIAL_7N1, etc.
+  if (databits == 7)
+  {
+    if (p == 'E')
+      return (stopbits == 2) ? SERIAL_7E2 : SERIAL_7E1;
+    if (p == 'O')
+      return (stopbits == 2) ? SERIAL_7O2 : SERIAL_7O1;
+    return (stopbits == 2) ? SERIAL_7N2 : SERIAL_7N1;
+  }
+  else
+  { // 8
+    if (p == 'E')
+      return (stopbits == 2) ? SERIAL_8E2 : SERIAL_8E1;
+    if (p == 'O')
+      return (stopbits == 2) ? SERIAL_8O2 : SERIAL_8O1;
+    return (stopbits == 2) ? SERIAL_8N2 : SERIAL_8N1;
+  }
+}
+
+void rs485Reinit()
+{
+  RS485.end();
+  delay(20);
+  RS485.begin(scfg.baud, parityToMode(scfg.parity, scfg.dataBits, scfg.stopBits),
+              PIN_RS485_RX, PIN_RS485_TX);
+  // With ModbusRTU (emelianov), begin can take driver (DE/RE) pin:
+  mb.begin(&RS485, PIN_RS485_DERE); // auto driver control
+  mb.slave(1);                      // Slave ID
+#if defined(MODBUSRTU_FRAME_STATS)
+  // Tolerate masters and USB adapters splitting frames by raising inter-frame time up to 4x of standard
+  mb.autoInterFrameTime(mb.interFrameTime() * 4);
+#endif
+}
+
+// Scale float to 16-bit register using the defined step
+uint16_t toReg(const Param &p)
+{
+  // round to nearest step then cast
+  float scaled = p.value / p.step;
+  if (scaled < 0)
+    scaled = 0; // guard
+  return (uint16_t)lroundf(scaled);
+}
+float fromReg(const Param &p, uint16_t regval)
+{
+  return (float)regval * p.step;
+}
+
+// ---------------- Simulator ----------------
+void simulatorBegin()
+{
+  // RS-485 UART & Modbus
+  pinMode(PIN_RS485_DERE, OUTPUT);
+  digitalWrite(PIN_RS485_DERE, LOW); // receive by default
+  rs485Reinit();                     // starts RS485 and mb
+
+  // Create holding registers and preload values
+  for (int i = 0; i < PARAM_COUNT; i++)
+  {
+    mb.addHreg(params[i].reg, toReg(params[i]));
+  }
+
+  // Diagnostic registers
+  mb.addIreg(DIAG_IREG, 0, DIAG_COUNT);
+
+#if defined(SIM_RTU_OVER_TCP)
+  // WiFi connects in background, server accepts connections once it is up
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(SIM_WIFI_SSID, SIM_WIFI_PASS);
+  mbNet.begin(SIM_RTU_TCP_PORT);
+  mbNet.slave(1);
+#endif
+#if defined(SIM_MODBUS_TCP)
+  mbTcp.server(SIM_TCP_PORT);
+  mbTcp.idleTimeout(SIM_TCP_IDLE_TIMEOUT);
+#endif
+}
+
+void simulatorTask()
+{
+  mb.task();
+#if defined(SIM_RTU_OVER_TCP)
+  mbNet.task();
+#endif
+#if defined(SIM_MODBUS_TCP)
+  mbTcp.task();
+#endif
+}
+
+static inline uint16_t sat16(uint32_t v)
+{
+  return v > 0xFFFF ? 0xFFFF : (uint16_t)v;
+}
+
+uint16_t diagReg(uint16_t offset)
+{
+#if defined(MODBUSRTU_STATS)
+  const TRTUTimestamps &ts = mb.timestamps();
+  const TRTULatency *l = mb.latency();
+  if (!l && offset < 10)
+    return 0;
+  switch (offset)
+  {
+  case 0:
+    return (uint16_t)l->count;
+  case 1:
+    return sat16(ts.txStart - ts.rx);
+  case 2:
+    return sat16(ts.txStart - ts.dispatch);
+  case 3:
+    return sat16(ts.txEnd - ts.txStart);
+  case 4:
+    return sat16(l->min);
+  case 5:
+    return sat16(l->max);
+  case 6:
+    return sat16((uint32_t)(l->sum / l->count));
+  case 7:
+    return sat16(mb.latencyPercentile(50));
+  case 8:
+    return sat16(mb.latencyPercentile(90));
+  case 9:
+    return sat16(mb.latencyPercentile(99));
+  }
+#endif
+#if defined(MODBUSRTU_FRAME_STATS)
+  const TRTUFrameStats &fs = mb.frameStats();
+  switch (offset)
+  {
+  case 10:
+    return (uint16_t)fs.frames;
+  case 11:
+    return (uint16_t)fs.crc;
+  case 12:
+    return (uint16_t)fs.t15;
+  case 13:
+    return (uint16_t)fs.overrun;
+  case 14:
+    return (uint16_t)fs.truncated;
+  case 15:
+    return (uint16_t)fs.split;
+  case 16:
+    return sat16(fs.maxGap);
+  case 17:
+    return sat16(mb.interFrameTime());
+  }
+#endif
+  (void)offset; // Unused if neither stats option is enabled
+  return 0;
+}
+
+bool paramFromReg(int i)
+{
+  // If a Modbus master wrote new values, reflect into model
+  uint16_t rv = mb.Hreg(params[i].reg);
+  float newVal = fromReg(params[i], rv);
+  if (fabsf(newVal - params[i].value) > (params[i].step * 0.5f))
+  {
+    params[i].value = clamp(newVal, params[i].minVal, params[i].maxVal);
+    return true;
+  }
+  return false;
+}
+
+void syncRegs()
+{
+  static uint32_t tSync = 0;
+  if (millis() - tSync > 300)
+  {
+    tSync = millis();
+    for (int i = 0; i < PARAM_COUNT; i++)
+    {
+      uint16_t cur = mb.Hreg(params[i].reg);
+      uint16_t need = toReg(params[i]);
+      if (cur != need)
+        mb.Hreg(params[i].reg, need);
+    }
+    for (uint16_t i = 0; i < DIAG_COUNT; i++)
+      mb.Ireg(DIAG_IREG + i, diagReg(i));
+  }
+}
@@ -0,0 +1,116 @@
+/*
+  ESP32 Modbus Sensor Simulator
+  Parameter model, serial configuration and Modbus register mapping.
+  Shared by the TFT firmware (main.cpp) and the headless host build (main_host.cpp).
+*/
+#pragma once
+
+#include <Arduino.h>
+#include <ModbusRTU.h>
+
+// ---------------- RS-485 pin map (adjust if needed) ----------------
+static const int PIN_RS485_RX = 16;  // UART1 RX
+static const int PIN_RS485_TX = 17;  // UART1 TX
+static const int PIN_RS485_DERE = 4; // MAX485 DE/RE tied together
+
+// ---------------- Modbus RTU ----------------
+extern HardwareSerial RS485;
+extern ModbusRTU mb;
+
+// ---------------- Modbus RTU over TCP (ESP32 with WiFi credentials only) ----------------
+// Build with -D SIM_WIFI_SSID=\"ssid\" -D SIM_WIFI_PASS=\"password\" to also serve RTU frames over TCP.
+// Registers are shared with the RS-485 slave (MODBUS_GLOBAL_REGS).
+#if defined(ESP32) && defined(SIM_WIFI_SSID)
+#define SIM_RTU_OVER_TCP
+#ifndef SIM_RTU_TCP_PORT
+#define SIM_RTU_TCP_PORT 502
+#endif
+#include <ModbusRTUTCP.h>
+extern ModbusRTUTCP mbNet;
+#endif
+
+// ---------------- Modbus TCP (host build only) ----------------
+// Headless build also serves Modbus TCP over host sockets, e.g. for loopback load generators.
+// Registers are shared with the RS-485 slave (MODBUS_GLOBAL_REGS).
+#if defined(ARDUINO_ARCH_HOST)
+#define SIM_MODBUS_TCP
+#ifndef SIM_TCP_PORT
+#define SIM_TCP_PORT 1502 // 502 requires root
+#endif
+#ifndef SIM_TCP_IDLE_TIMEOUT
+#define SIM_TCP_IDLE_TIMEOUT 300000 // mS, sessions of masters gone without closing them are freed
+#endif
+#include <ModbusTCP.h>
+extern ModbusTCP mbTcp;
+#endif
+
+// ---------------- Parameters & registers ----------------
+// Holding register mapping:
+// 1: pH       (0.01 step)
+// 2: TDS ppm  (1 step)
+// 3: TSS NTU  (1 step)  -- "Turbidity"
+// 4: COD mg/L (1 step)
+// 5: BOD mg/L (1 step)
+// 6: DO mg/L  (0.01 step)
+// 7: NH3-N mg/L (0.01 step)
+
+struct Param
+{
+  const char *name;
+  const char *unit;
+  float minVal;
+  float maxVal;
+  float step;   // UI increment, also scaling for Hreg
+  uint16_t reg; // Hreg address (1..)
+  float value;  // actual (float)
+};
+
+extern Param params[];
+extern const int PARAM_COUNT;
+
+// ---------------- Serial configuration model ----------------
+struct SerialCfg
+{
+  uint32_t baud;
+  uint8_t dataBits; // 7 or 8
+  char parity;      // 'N','E','O'
+  uint8_t stopBits; // 1 or 2
+};
+
+extern SerialCfg scfg;
+extern const uint32_t BAUDS[];
+extern const int BAUD_COUNT;
+
+// ---------------- Utils ----------------
+template <typename T>
+T clamp(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+uint32_t parityToMode(char p, uint8_t databits, uint8_t stopbits);
+void rs485Reinit(); // Inter-frame time auto-tune is restarted from the standard 3.5 char value
+
+// Scale float to 16-bit register using the defined step
+uint16_t toReg(const Param &p);
+float fromReg(const Param &p, uint16_t regval);
+
+// ---------------- Diagnostics ----------------
+// Input register block with slave turnaround statistics (MODBUSRTU_STATS builds).
+// Times are in uS saturated to 65535, measured from last request byte received to response transmission start.
+// 100: requests answered (low 16 bits)   101: last turnaround   102: last processing (dispatch -> TX start)
+// 103: last TX duration                   104: min   105: max   106: mean   107: p50   108: p90   109: p99
+// Receive framing counters (MODBUSRTU_FRAME_STATS builds), low 16 bits:
+// 110: frames   111: CRC errors   112: t1.5 violations   113: overruns   114: truncated   115: split frames
+// 116: longest inter-character gap uS   117: current inter-frame time uS (raised on split frames)
+static const uint16_t DIAG_IREG = 100;
+static const uint16_t DIAG_COUNT = 18;
+
+// ---------------- Simulator ----------------
+// Start RS-485 UART & Modbus and create holding registers preloaded with parameter values
+void simulatorBegin();
+// Process Modbus requests on all transports (must be called often)
+void simulatorTask();
+// Take value written by a Modbus master into parameter i. Returns true if the parameter changed.
+bool paramFromReg(int i);
+// Periodically keep Hregs synced with our internal values (when user edits) and refresh diagnostic Iregs
+void syncRegs();
+// Read diagnostic block values as published in Iregs
+uint16_t diagReg(uint16_t offset);